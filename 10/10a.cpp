@@ -1,22 +1,69 @@
+#include <algorithm>
+#include <bit>
+#include <bitset>
 #include <cctype>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <numeric>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
-struct Mask {
-  std::uint16_t bits{0};
-  std::string repr{};
+// Light patterns are stored in the narrowest type that holds all B lights:
+// uint16_t, uint32_t or uint64_t, or a WideBits bitset for B > 64. The
+// solvers are templates over that type, and Problem holds whichever one the
+// parser picked.
+using WideBits = std::bitset<256>;
+
+constexpr int maxLights{256};
+// The BFS solvers index a 2^B state table, so they stop at this many lights.
+constexpr int maxBfsLights{24};
+// solveGF2 packs one button per bit of a uint64_t.
+constexpr std::size_t maxGF2Buttons{64};
+
+template <typename Bits> bool testBit(const Bits &bits, int i) {
+  if constexpr (std::is_integral_v<Bits>) {
+    return (bits >> i) & 1U;
+  } else {
+    return bits.test(static_cast<std::size_t>(i));
+  }
+}
+
+template <typename Bits> void setBit(Bits &bits, int i) {
+  if constexpr (std::is_integral_v<Bits>) {
+    bits = static_cast<Bits>(bits | (Bits{1} << i));
+  } else {
+    bits.set(static_cast<std::size_t>(i));
+  }
+}
+
+template <typename Bits> struct Mask {
+  Bits bits{};
 };
 
-struct Problem {
+template <typename Bits> struct BasicProblem {
   int B{0};
-  std::uint32_t target{0U};
-  std::vector<Mask> masks{};
+  Bits target{};
+  std::vector<Mask<Bits>> masks{};
+  std::vector<int> joltage{};
 };
 
+using Problem =
+    std::variant<BasicProblem<std::uint16_t>, BasicProblem<std::uint32_t>,
+                 BasicProblem<std::uint64_t>, BasicProblem<WideBits>>;
+
+static int lightCount(const Problem &problem) {
+  return std::visit([](const auto &p) { return p.B; }, problem);
+}
+
 static std::string stripSpaces(const std::string &s) {
   std::string out{};
   out.reserve(s.size());
@@ -30,23 +77,25 @@ static std::string stripSpaces(const std::string &s) {
 
 // Convention: RIGHTMOST char in [...] is bit 0.
 // Example: ".##." -> 0110
-static std::uint32_t parseTargetRightLSB(const std::string &targetStr) {
+template <typename Bits>
+static Bits parseTargetRightLSB(const std::string &targetStr) {
   const int B{static_cast<int>(targetStr.size())};
-  std::uint32_t t{0U};
+  Bits t{};
 
   for (int i{0}; i < B; ++i) {
     const char ch{targetStr[static_cast<std::size_t>(B - 1 - i)]};
     if (ch == '#') {
-      t |= (1U << static_cast<std::uint32_t>(i));
+      setBit(t, i);
     }
   }
   return t;
 }
 
 // Parse "(1,3,4)" into a bitmask; ignore indices >= B.
-static Mask parseParenMask(const std::string &insideRaw, int B) {
+template <typename Bits>
+static Mask<Bits> parseParenMask(const std::string &insideRaw, int B) {
   const std::string inside{stripSpaces(insideRaw)};
-  std::uint32_t m{0U};
+  Bits m{};
 
   if (!inside.empty()) {
     std::size_t i{0U};
@@ -69,7 +118,7 @@ static Mask parseParenMask(const std::string &insideRaw, int B) {
 
       if (anyDigit && !neg) {
         if (val >= 0 && val < B) {
-          m |= (1U << static_cast<std::uint32_t>(B - 1 - val));
+          setBit(m, B - 1 - val);
         }
       }
 
@@ -82,7 +131,24 @@ static Mask parseParenMask(const std::string &insideRaw, int B) {
     }
   }
 
-  return Mask{static_cast<std::uint16_t>(m)};
+  return Mask<Bits>{m};
+}
+
+template <typename Bits>
+static BasicProblem<Bits>
+buildProblem(const std::string &targetStr,
+             const std::vector<std::string> &buttons,
+             std::vector<int> joltage) {
+  const int B{static_cast<int>(targetStr.size())};
+
+  std::vector<Mask<Bits>> masks{};
+  masks.reserve(buttons.size());
+  for (const std::string &inside : buttons) {
+    masks.push_back(parseParenMask<Bits>(inside, B));
+  }
+
+  return BasicProblem<Bits>{B, parseTargetRightLSB<Bits>(targetStr),
+                            std::move(masks), std::move(joltage)};
 }
 
 static bool parseLineToProblem(const std::string &line, Problem &out) {
@@ -90,7 +156,7 @@ static bool parseLineToProblem(const std::string &line, Problem &out) {
     return false;
   }
 
-  // treat '{' as end-of-line
+  // everything from '{' on is the joltage list
   const std::size_t brace{line.find('{')};
   const std::string prefix{brace == std::string::npos ? line
                                                       : line.substr(0U, brace)};
@@ -103,13 +169,11 @@ static bool parseLineToProblem(const std::string &line, Problem &out) {
 
   const std::string targetStr{prefix.substr(lb + 1U, rb - (lb + 1U))};
   const int B{static_cast<int>(targetStr.size())};
-  if (B <= 0 || B > 24) {
+  if (B <= 0 || B > maxLights) {
     return false;
   }
 
-  const std::uint32_t target{parseTargetRightLSB(targetStr)};
-
-  std::vector<Mask> masks{};
+  std::vector<std::string> buttons{};
   std::size_t pos{rb + 1U};
 
   while (true) {
@@ -123,20 +187,56 @@ static bool parseLineToProblem(const std::string &line, Problem &out) {
     }
 
     const std::string inside{prefix.substr(p1 + 1U, p2 - (p1 + 1U))};
-    masks.push_back(parseParenMask(inside, B));
+    buttons.push_back(inside);
 
     pos = p2 + 1U;
   }
 
-  out = Problem{B, target, masks};
+  std::vector<int> joltage{};
+  if (brace != std::string::npos) {
+    const std::size_t close{line.find('}', brace + 1U)};
+    const std::string inside{stripSpaces(line.substr(
+        brace + 1U, close == std::string::npos ? std::string::npos
+                                               : close - (brace + 1U)))};
+    std::size_t i{0U};
+    while (i < inside.size()) {
+      int val{0};
+      bool anyDigit{false};
+      while (i < inside.size() &&
+             std::isdigit(static_cast<unsigned char>(inside[i]))) {
+        anyDigit = true;
+        val = val * 10 + (inside[i] - '0');
+        ++i;
+      }
+      if (anyDigit) {
+        joltage.push_back(val);
+      }
+      while (i < inside.size() && inside[i] != ',') {
+        ++i;
+      }
+      if (i < inside.size()) {
+        ++i;
+      }
+    }
+  }
+
+  if (B <= 16) {
+    out = buildProblem<std::uint16_t>(targetStr, buttons, std::move(joltage));
+  } else if (B <= 32) {
+    out = buildProblem<std::uint32_t>(targetStr, buttons, std::move(joltage));
+  } else if (B <= 64) {
+    out = buildProblem<std::uint64_t>(targetStr, buttons, std::move(joltage));
+  } else {
+    out = buildProblem<WideBits>(targetStr, buttons, std::move(joltage));
+  }
   return true;
 }
 
-static std::string toBits(std::uint32_t v, int B) {
+template <typename Bits> static std::string toBits(const Bits &v, int B) {
   std::string s{};
   s.reserve(static_cast<std::size_t>(B));
   for (int i{B - 1}; i >= 0; --i) {
-    s.push_back(((v >> static_cast<std::uint32_t>(i)) & 1U) ? '1' : '0');
+    s.push_back(testBit(v, i) ? '1' : '0');
   }
   return s;
 }
@@ -153,7 +253,7 @@ static std::vector<Problem> readProblemsFromFile(const std::string &filename) {
   while (std::getline(file, line)) {
     Problem p{};
     if (parseLineToProblem(line, p)) {
-      problems.push_back(p);
+      problems.push_back(std::move(p));
     }
   }
 
@@ -164,12 +264,16 @@ static std::vector<Problem> readProblemsFromFile(const std::string &filename) {
  * Actual code not just input handling
  */
 
-int fewestButtonPresses(const std::vector<Problem> &problems) {
-  int count{};
-  for (const auto &p : problems) {
+template <typename Bits>
+static int bfsReference(const BasicProblem<Bits> &p) {
+  if constexpr (!std::is_integral_v<Bits>) {
+    return -1;
+  } else {
     int B{p.B};
+    if (B > maxBfsLights) {
+      return -1;
+    }
     const int maxState{1 << B};
-    std::size_t M{p.masks.size()};
 
     std::vector<int> dist;
     dist.assign(maxState, -1);
@@ -187,12 +291,12 @@ int fewestButtonPresses(const std::vector<Problem> &problems) {
     while (head < queue.size()) {
       const int s{queue[head++]};
 
-      if (static_cast<std::uint32_t>(s) == p.target) {
+      if (static_cast<Bits>(s) == p.target) {
         localCount = dist[static_cast<std::size_t>(s)];
         break;
       }
 
-      for (const Mask &m : p.masks) {
+      for (const Mask<Bits> &m : p.masks) {
         const int next{s ^ static_cast<int>(m.bits)};
         if (dist[static_cast<std::size_t>(next)] == -1) {
           dist[static_cast<std::size_t>(next)] =
@@ -202,6 +306,676 @@ int fewestButtonPresses(const std::vector<Problem> &problems) {
       }
     }
 
+    return localCount;
+  }
+}
+
+template <typename Bits> static bool bfsSupported(const BasicProblem<Bits> &p) {
+  return std::is_integral_v<Bits> && p.B <= maxBfsLights;
+}
+
+static bool bfsSupported(const Problem &problem) {
+  return std::visit([](const auto &p) { return bfsSupported(p); }, problem);
+}
+
+// Machines a solver cannot handle are left out of the total, not summed as
+// -1 like an unreachable target.
+static void reportSkipped(std::size_t index, const std::string &reason) {
+  std::cerr << "Skipping machine " << index << ": " << reason << '\n';
+}
+
+int fewestButtonPresses(const std::vector<Problem> &problems) {
+  int count{};
+  for (std::size_t i{0}; i < problems.size(); ++i) {
+    const Problem &problem{problems[i]};
+    if (!bfsSupported(problem)) {
+      reportSkipped(i, std::to_string(lightCount(problem)) +
+                           " lights is too many for BFS");
+      continue;
+    }
+    const int localCount{std::visit(
+        [](const auto &p) { return bfsReference(p); }, problem)};
+    count += localCount;
+
+    std::cout << localCount << '\n';
+  }
+  return count;
+}
+
+// Per-thread BFS buffers, reused from one machine to the next so that only
+// the first 2^B bits of visited are ever cleared.
+struct BfsScratch {
+  std::vector<std::uint64_t> visited{};
+  std::vector<std::uint32_t> frontier{};
+  std::vector<std::uint32_t> next{};
+};
+
+// Same BFS as fewestButtonPresses, but level by level: the distance is just
+// the level counter (a uint8_t, as no answer exceeds B <= 24) and visited is
+// one bit per state instead of an int.
+template <typename Bits>
+static int bfsPresses(const BasicProblem<Bits> &p, BfsScratch &scratch) {
+  if constexpr (!std::is_integral_v<Bits>) {
+    return -1;
+  } else {
+    if (p.B > maxBfsLights) {
+      return -1;
+    }
+    const std::size_t words{((std::size_t{1} << p.B) + 63U) / 64U};
+    if (scratch.visited.size() < words) {
+      scratch.visited.resize(words);
+    }
+    std::fill_n(scratch.visited.begin(), words, 0U);
+
+    auto markNew = [&scratch](std::uint32_t s) {
+      std::uint64_t &word{scratch.visited[s / 64U]};
+      const std::uint64_t bit{std::uint64_t{1} << (s % 64U)};
+      const bool fresh{(word & bit) == 0U};
+      word |= bit;
+      return fresh;
+    };
+
+    scratch.frontier.clear();
+    scratch.frontier.push_back(0U);
+    markNew(0U);
+
+    for (std::uint8_t level{0}; !scratch.frontier.empty(); ++level) {
+      scratch.next.clear();
+      for (const std::uint32_t s : scratch.frontier) {
+        if (s == p.target) {
+          return level;
+        }
+        for (const Mask<Bits> &m : p.masks) {
+          const std::uint32_t n{s ^ static_cast<std::uint32_t>(m.bits)};
+          if (markNew(n)) {
+            scratch.next.push_back(n);
+          }
+        }
+      }
+      std::swap(scratch.frontier, scratch.next);
+    }
+    return -1;
+  }
+}
+
+// XOR-ing every index of a bitset by m permutes its bits. The high bits of
+// m (>= 6) move whole words: word w goes to w ^ (m >> 6). The low six bits
+// permute bits inside each word, one delta swap per set bit: swapping the
+// halves of every 2^(k+1)-bit block exchanges bit i with bit i ^ 2^k.
+static std::uint64_t xorPermuteWord(std::uint64_t x, std::uint32_t low) {
+  static constexpr std::uint64_t lowerHalf[6]{
+      0x5555555555555555ULL, 0x3333333333333333ULL, 0x0F0F0F0F0F0F0F0FULL,
+      0x00FF00FF00FF00FFULL, 0x0000FFFF0000FFFFULL, 0x00000000FFFFFFFFULL,
+  };
+
+  for (int k{0}; k < 6; ++k) {
+    if ((low >> k) & 1U) {
+      const int shift{1 << k};
+      x = ((x >> shift) & lowerHalf[k]) | ((x & lowerHalf[k]) << shift);
+    }
+  }
+  return x;
+}
+
+struct BitsetBfsScratch {
+  std::vector<std::uint64_t> visited{};
+  std::vector<std::uint64_t> frontier{};
+  std::vector<std::uint64_t> next{};
+};
+
+// Level-synchronous BFS where the frontier and visited sets are 2^B-bit
+// bitsets. Each level streams once over the frontier per mask, ORing the
+// XOR-permuted words into next, instead of probing states one at a time.
+template <typename Bits>
+static int bitsetBfsPresses(const BasicProblem<Bits> &p,
+                            BitsetBfsScratch &scratch) {
+  if constexpr (!std::is_integral_v<Bits>) {
+    return -1;
+  } else {
+    if (p.B > maxBfsLights) {
+      return -1;
+    }
+    const std::size_t words{((std::size_t{1} << p.B) + 63U) / 64U};
+
+    scratch.visited.assign(words, 0U);
+    scratch.frontier.assign(words, 0U);
+    scratch.next.resize(words);
+
+    scratch.frontier[0] = 1U;
+    scratch.visited[0] = 1U;
+
+    const std::size_t targetWord{static_cast<std::size_t>(p.target / 64U)};
+    const std::uint64_t targetBit{std::uint64_t{1} << (p.target % 64U)};
+
+    for (std::uint8_t level{0};; ++level) {
+      if (scratch.frontier[targetWord] & targetBit) {
+        return level;
+      }
+
+      std::fill(scratch.next.begin(), scratch.next.end(), 0U);
+      for (const Mask<Bits> &m : p.masks) {
+        const std::size_t wordXor{static_cast<std::size_t>(m.bits) >> 6};
+        const std::uint32_t low{static_cast<std::uint32_t>(m.bits) & 63U};
+
+        for (std::size_t w{0}; w < words; ++w) {
+          if (scratch.frontier[w] != 0U) {
+            scratch.next[w ^ wordXor] |=
+                xorPermuteWord(scratch.frontier[w], low);
+          }
+        }
+      }
+
+      bool any{false};
+      for (std::size_t w{0}; w < words; ++w) {
+        scratch.next[w] &= ~scratch.visited[w];
+        scratch.visited[w] |= scratch.next[w];
+        any = any || scratch.next[w] != 0U;
+      }
+      if (!any) {
+        return -1;
+      }
+      std::swap(scratch.frontier, scratch.next);
+    }
+  }
+}
+
+// fewestButtonPresses on the bitset BFS, with one set of buffers shared by
+// every machine.
+int fewestButtonPressesBitset(const std::vector<Problem> &problems) {
+  BitsetBfsScratch scratch{};
+  int count{};
+  for (std::size_t i{0}; i < problems.size(); ++i) {
+    const Problem &problem{problems[i]};
+    if (!bfsSupported(problem)) {
+      reportSkipped(i, std::to_string(lightCount(problem)) +
+                           " lights is too many for BFS");
+      continue;
+    }
+    count += std::visit(
+        [&scratch](const auto &p) { return bitsetBfsPresses(p, scratch); },
+        problem);
+  }
+  return count;
+}
+
+// One deque of task indices per worker. A worker takes from the front of its
+// own deque and, once that is empty, steals from the back of the others.
+class WorkStealingQueues {
+private:
+  struct Queue {
+    std::deque<std::size_t> tasks{};
+    std::mutex mutex{};
+  };
+
+  std::vector<Queue> m_queues;
+
+public:
+  explicit WorkStealingQueues(std::size_t workers) : m_queues(workers) {}
+
+  void push(std::size_t worker, std::size_t task) {
+    m_queues[worker].tasks.push_back(task);
+  }
+
+  bool pop(std::size_t worker, std::size_t &task) {
+    {
+      Queue &own{m_queues[worker]};
+      std::lock_guard lock{own.mutex};
+      if (!own.tasks.empty()) {
+        task = own.tasks.front();
+        own.tasks.pop_front();
+        return true;
+      }
+    }
+
+    for (std::size_t k{1}; k < m_queues.size(); ++k) {
+      Queue &victim{m_queues[(worker + k) % m_queues.size()]};
+      std::lock_guard lock{victim.mutex};
+      if (!victim.tasks.empty()) {
+        task = victim.tasks.back();
+        victim.tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// Solves every machine with bfsPresses on threadCount workers. Machines are
+// dealt out largest-B first so the expensive ones start early and the small
+// ones fill in the gaps; each worker keeps one BfsScratch throughout.
+int fewestButtonPressesParallel(const std::vector<Problem> &problems,
+                                unsigned threadCount) {
+  const std::size_t workers{std::max(1U, threadCount)};
+
+  std::vector<std::size_t> order{};
+  order.reserve(problems.size());
+  for (std::size_t i{0}; i < problems.size(); ++i) {
+    if (bfsSupported(problems[i])) {
+      order.push_back(i);
+    } else {
+      reportSkipped(i, std::to_string(lightCount(problems[i])) +
+                           " lights is too many for BFS");
+    }
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&problems](std::size_t a, std::size_t b) {
+                     return lightCount(problems[a]) > lightCount(problems[b]);
+                   });
+
+  WorkStealingQueues queues{workers};
+  for (std::size_t k{0}; k < order.size(); ++k) {
+    queues.push(k % workers, order[k]);
+  }
+
+  // Skipped machines keep their 0.
+  std::vector<int> results(problems.size(), 0);
+  std::vector<std::thread> threads{};
+  threads.reserve(workers);
+
+  for (std::size_t w{0}; w < workers; ++w) {
+    threads.emplace_back([&problems, &queues, &results, w]() {
+      BfsScratch scratch{};
+      std::size_t task{};
+      while (queues.pop(w, task)) {
+        results[task] = std::visit(
+            [&scratch](const auto &p) { return bfsPresses(p, scratch); },
+            problems[task]);
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+
+  int count{};
+  for (const int localCount : results) {
+    count += localCount;
+  }
+  return count;
+}
+
+/*
+ * Pressing a button twice cancels out, so each machine is the linear
+ * system A x = target over GF(2): column j of A is button j's mask and x
+ * says which buttons are pressed. The answer is the fewest set bits in any
+ * solution x.
+ */
+
+// Gaussian elimination of the system, one row per light. Each row packs its
+// button coefficients into the low bits of a uint64_t (so at most 64
+// buttons) and its right-hand side into rhs.
+struct GF2System {
+  bool consistent{true};
+  std::uint64_t particular{0U};
+  std::vector<std::uint64_t> nullBasis{};
+};
+
+template <typename Bits>
+static GF2System eliminateGF2(const BasicProblem<Bits> &p) {
+  const int M{static_cast<int>(p.masks.size())};
+
+  std::vector<std::uint64_t> rows(static_cast<std::size_t>(p.B), 0U);
+  std::vector<int> rhs(static_cast<std::size_t>(p.B), 0);
+
+  for (int b{0}; b < p.B; ++b) {
+    for (int j{0}; j < M; ++j) {
+      if (testBit(p.masks[static_cast<std::size_t>(j)].bits, b)) {
+        rows[static_cast<std::size_t>(b)] |= std::uint64_t{1} << j;
+      }
+    }
+    rhs[static_cast<std::size_t>(b)] = testBit(p.target, b) ? 1 : 0;
+  }
+
+  std::vector<int> pivotCol{};
+  std::size_t rank{0U};
+
+  for (int col{0}; col < M && rank < rows.size(); ++col) {
+    const std::uint64_t bit{std::uint64_t{1} << col};
+
+    std::size_t pivot{rank};
+    while (pivot < rows.size() && !(rows[pivot] & bit)) {
+      ++pivot;
+    }
+    if (pivot == rows.size()) {
+      continue;
+    }
+    std::swap(rows[pivot], rows[rank]);
+    std::swap(rhs[pivot], rhs[rank]);
+
+    for (std::size_t r{0}; r < rows.size(); ++r) {
+      if (r != rank && (rows[r] & bit)) {
+        rows[r] ^= rows[rank];
+        rhs[r] ^= rhs[rank];
+      }
+    }
+    pivotCol.push_back(col);
+    ++rank;
+  }
+
+  GF2System sys{};
+
+  for (std::size_t r{rank}; r < rows.size(); ++r) {
+    if (rhs[r] != 0) {
+      sys.consistent = false;
+      return sys;
+    }
+  }
+
+  std::uint64_t pivotMask{0U};
+  for (std::size_t r{0}; r < rank; ++r) {
+    pivotMask |= std::uint64_t{1} << pivotCol[r];
+    if (rhs[r] != 0) {
+      sys.particular |= std::uint64_t{1} << pivotCol[r];
+    }
+  }
+
+  // Each free button, pressed on its own, plus the pivot buttons that then
+  // cancel it out.
+  for (int f{0}; f < M; ++f) {
+    const std::uint64_t bit{std::uint64_t{1} << f};
+    if (pivotMask & bit) {
+      continue;
+    }
+    std::uint64_t v{bit};
+    for (std::size_t r{0}; r < rank; ++r) {
+      if (rows[r] & bit) {
+        v |= std::uint64_t{1} << pivotCol[r];
+      }
+    }
+    sys.nullBasis.push_back(v);
+  }
+
+  return sys;
+}
+
+// Fewest presses by splitting the buttons in half: every subset of the first
+// half is tabulated by the lights it toggles, then every subset of the second
+// half looks up the rest of the target. O(2^(M/2)).
+template <typename Bits>
+static int meetInTheMiddle(const BasicProblem<Bits> &p) {
+  const std::size_t M{p.masks.size()};
+  const std::size_t half{M / 2};
+
+  std::unordered_map<Bits, int> firstHalf{};
+  firstHalf.reserve(std::size_t{1} << half);
+
+  Bits state{};
+  for (std::uint64_t i{0}; i < (std::uint64_t{1} << half); ++i) {
+    if (i != 0) {
+      state ^= p.masks[static_cast<std::size_t>(std::countr_zero(i))].bits;
+    }
+    const int presses{std::popcount(i ^ (i >> 1))};
+    auto [it, inserted]{firstHalf.try_emplace(state, presses)};
+    if (!inserted && presses < it->second) {
+      it->second = presses;
+    }
+  }
+
+  int best{-1};
+  state = Bits{};
+  for (std::uint64_t i{0}; i < (std::uint64_t{1} << (M - half)); ++i) {
+    if (i != 0) {
+      state ^=
+          p.masks[half + static_cast<std::size_t>(std::countr_zero(i))].bits;
+    }
+    auto it{firstHalf.find(static_cast<Bits>(state ^ p.target))};
+    if (it != firstHalf.end()) {
+      const int presses{it->second + std::popcount(i ^ (i >> 1))};
+      if (best < 0 || presses < best) {
+        best = presses;
+      }
+    }
+  }
+  return best;
+}
+
+// Minimum presses for one machine, or -1 if the target is unreachable.
+// Walks the 2^nullity solutions in Gray-code order (one XOR per step) unless
+// 2^(M/2) is cheaper, in which case it meets in the middle instead.
+template <typename Bits> static int solveGF2(const BasicProblem<Bits> &p) {
+  const std::size_t M{p.masks.size()};
+  if (M > maxGF2Buttons) {
+    return -1;
+  }
+
+  const GF2System sys{eliminateGF2(p)};
+  if (!sys.consistent) {
+    return -1;
+  }
+
+  const std::size_t nullity{sys.nullBasis.size()};
+  if (nullity > (M + 1) / 2 + 1) {
+    return meetInTheMiddle(p);
+  }
+
+  std::uint64_t x{sys.particular};
+  int best{std::popcount(x)};
+
+  for (std::uint64_t i{1}; i < (std::uint64_t{1} << nullity); ++i) {
+    x ^= sys.nullBasis[static_cast<std::size_t>(std::countr_zero(i))];
+    best = std::min(best, std::popcount(x));
+  }
+  return best;
+}
+
+int fewestButtonPressesGF2(const std::vector<Problem> &problems) {
+  int count{};
+  for (std::size_t i{0}; i < problems.size(); ++i) {
+    const Problem &problem{problems[i]};
+    const std::size_t buttons{std::visit(
+        [](const auto &p) { return p.masks.size(); }, problem)};
+    if (buttons > maxGF2Buttons) {
+      reportSkipped(i,
+                    std::to_string(buttons) + " buttons is too many for GF2");
+      continue;
+    }
+    const int localCount{
+        std::visit([](const auto &p) { return solveGF2(p); }, problem)};
+    count += localCount;
+
+    std::cout << localCount << '\n';
+  }
+  return count;
+}
+
+/*
+ * Joltage mode: every press adds 1 to each counter its button touches, and
+ * each counter must end exactly at its target. That is A x = joltage with
+ * x >= 0 integer, where A[i][j] is 1 if button j touches counter i, and
+ * the answer minimises sum(x).
+ */
+
+// Fraction-free Gauss-Jordan elimination: each pivot row says
+// d * x_pivot = c - sum(a_f * x_f) over the free buttons f.
+struct JoltageSystem {
+  bool consistent{true};
+  std::vector<int> freeCols{};
+  std::vector<int> pivotCols{};
+  std::vector<long long> pivotDen{};
+  std::vector<long long> pivotRhs{};
+  std::vector<std::vector<long long>> pivotFree{};
+};
+
+template <typename Bits>
+static JoltageSystem eliminateJoltage(const BasicProblem<Bits> &p) {
+  const int M{static_cast<int>(p.masks.size())};
+  const int B{p.B};
+
+  std::vector<std::vector<long long>> rows(
+      static_cast<std::size_t>(B), std::vector<long long>(M + 1, 0));
+  for (int i{0}; i < B; ++i) {
+    for (int j{0}; j < M; ++j) {
+      if (testBit(p.masks[static_cast<std::size_t>(j)].bits, B - 1 - i)) {
+        rows[static_cast<std::size_t>(i)][static_cast<std::size_t>(j)] = 1;
+      }
+    }
+    rows[static_cast<std::size_t>(i)][static_cast<std::size_t>(M)] =
+        p.joltage[static_cast<std::size_t>(i)];
+  }
+
+  JoltageSystem sys{};
+  std::size_t rank{0};
+
+  for (int col{0}; col < M; ++col) {
+    std::size_t pivot{rank};
+    while (pivot < rows.size() && rows[pivot][col] == 0) {
+      ++pivot;
+    }
+    if (pivot == rows.size()) {
+      sys.freeCols.push_back(col);
+      continue;
+    }
+    std::swap(rows[pivot], rows[rank]);
+    if (rows[rank][col] < 0) {
+      for (long long &v : rows[rank]) {
+        v = -v;
+      }
+    }
+
+    for (std::size_t r{0}; r < rows.size(); ++r) {
+      if (r == rank || rows[r][col] == 0) {
+        continue;
+      }
+      const long long a{rows[rank][col]};
+      const long long b{rows[r][col]};
+      long long g{0};
+      for (std::size_t k{0}; k < rows[r].size(); ++k) {
+        rows[r][k] = rows[r][k] * a - rows[rank][k] * b;
+        g = std::gcd(g, rows[r][k]);
+      }
+      if (g > 1) {
+        for (long long &v : rows[r]) {
+          v /= g;
+        }
+      }
+    }
+    sys.pivotCols.push_back(col);
+    ++rank;
+  }
+
+  for (std::size_t r{rank}; r < rows.size(); ++r) {
+    if (rows[r][static_cast<std::size_t>(M)] != 0) {
+      sys.consistent = false;
+      return sys;
+    }
+  }
+
+  for (std::size_t r{0}; r < rank; ++r) {
+    sys.pivotDen.push_back(rows[r][static_cast<std::size_t>(sys.pivotCols[r])]);
+    sys.pivotRhs.push_back(rows[r][static_cast<std::size_t>(M)]);
+    std::vector<long long> coeffs{};
+    for (int f : sys.freeCols) {
+      coeffs.push_back(rows[r][static_cast<std::size_t>(f)]);
+    }
+    sys.pivotFree.push_back(std::move(coeffs));
+  }
+  return sys;
+}
+
+// Fewest presses reaching every joltage target exactly, or -1. Only the
+// free buttons are branched on, each between 0 and the smallest target of
+// the counters it touches. The pivot buttons follow from them, and a branch
+// is cut as soon as some pivot can no longer be made non-negative or the
+// objective can no longer beat the best total found.
+template <typename Bits>
+static long long solveJoltage(const BasicProblem<Bits> &p) {
+  if (p.joltage.size() != static_cast<std::size_t>(p.B)) {
+    return -1;
+  }
+
+  const JoltageSystem sys{eliminateJoltage(p)};
+  if (!sys.consistent) {
+    return -1;
+  }
+
+  const std::size_t F{sys.freeCols.size()};
+  const std::size_t P{sys.pivotCols.size()};
+
+  std::vector<long long> upper(F, 0);
+  for (std::size_t f{0}; f < F; ++f) {
+    const Bits &bits{p.masks[static_cast<std::size_t>(sys.freeCols[f])].bits};
+    long long ub{-1};
+    for (int i{0}; i < p.B; ++i) {
+      if (testBit(bits, p.B - 1 - i)) {
+        const long long t{p.joltage[static_cast<std::size_t>(i)]};
+        ub = ub < 0 ? t : std::min(ub, t);
+      }
+    }
+    upper[f] = std::max(ub, 0LL);
+  }
+
+  // Objective scaled by L = lcm of the pivot denominators, so that
+  // L * sum(x) = base + sum(gain_f * x_f) stays in integers.
+  long long L{1};
+  for (long long d : sys.pivotDen) {
+    L = std::lcm(L, d);
+  }
+  long long base{0};
+  std::vector<long long> gain(F, L);
+  for (std::size_t r{0}; r < P; ++r) {
+    const long long scale{L / sys.pivotDen[r]};
+    base += scale * sys.pivotRhs[r];
+    for (std::size_t f{0}; f < F; ++f) {
+      gain[f] -= scale * sys.pivotFree[r][f];
+    }
+  }
+
+  // Smallest contribution the free buttons from index f onwards can still
+  // make, to each pivot row and to the objective.
+  std::vector<std::vector<long long>> rowSlack(
+      F + 1, std::vector<long long>(P, 0));
+  std::vector<long long> gainSlack(F + 1, 0);
+  for (std::size_t f{F}; f-- > 0;) {
+    for (std::size_t r{0}; r < P; ++r) {
+      rowSlack[f][r] = rowSlack[f + 1][r] +
+                       std::min(0LL, sys.pivotFree[r][f] * upper[f]);
+    }
+    gainSlack[f] = gainSlack[f + 1] + std::min(0LL, gain[f] * upper[f]);
+  }
+
+  long long best{-1};
+  std::vector<long long> used(P, 0);
+
+  auto search = [&](auto &self, std::size_t f, long long objective) -> void {
+    if (best >= 0 && base + objective + gainSlack[f] >= best * L) {
+      return;
+    }
+    for (std::size_t r{0}; r < P; ++r) {
+      if (used[r] + rowSlack[f][r] > sys.pivotRhs[r]) {
+        return;
+      }
+    }
+
+    if (f == F) {
+      for (std::size_t r{0}; r < P; ++r) {
+        if ((sys.pivotRhs[r] - used[r]) % sys.pivotDen[r] != 0) {
+          return;
+        }
+      }
+      best = (base + objective) / L;
+      return;
+    }
+
+    for (long long x{0}; x <= upper[f]; ++x) {
+      for (std::size_t r{0}; r < P; ++r) {
+        used[r] += sys.pivotFree[r][f] * x;
+      }
+      self(self, f + 1, objective + gain[f] * x);
+      for (std::size_t r{0}; r < P; ++r) {
+        used[r] -= sys.pivotFree[r][f] * x;
+      }
+    }
+  };
+
+  search(search, 0, 0);
+  return best;
+}
+
+long long fewestJoltagePresses(const std::vector<Problem> &problems) {
+  long long count{};
+  for (const auto &problem : problems) {
+    const long long localCount{
+        std::visit([](const auto &p) { return solveJoltage(p); }, problem)};
     count += localCount;
 
     std::cout << localCount << '\n';
@@ -212,17 +986,25 @@ int fewestButtonPresses(const std::vector<Problem> &problems) {
 int main() {
   const std::vector<Problem> problems{readProblemsFromFile("input.txt")};
 
-  for (const auto &p : problems) {
-    int B{p.B};
-    std::cout << toBits(p.target, B) << '\n';
-    for (const auto &masks : p.masks) {
-      std::cout << '(' << toBits(masks.bits, B) << ")\n";
-    }
+  for (const auto &problem : problems) {
+    std::visit(
+        [](const auto &p) {
+          int B{p.B};
+          std::cout << toBits(p.target, B) << '\n';
+          for (const auto &masks : p.masks) {
+            std::cout << '(' << toBits(masks.bits, B) << ")\n";
+          }
+        },
+        problem);
   }
 
-  int count{fewestButtonPresses(problems)};
+  int count{fewestButtonPressesGF2(problems)};
 
   std::cout << count << '\n';
 
+  long long joltageCount{fewestJoltagePresses(problems)};
+
+  std::cout << joltageCount << '\n';
+
   return 0;
 }
@@ -1,71 +1,368 @@
+#include <algorithm>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
-#include <istream>
-#include <sstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+// Interns node names to dense ids 0, 1, 2, ... Names of up to four lowercase
+// letters pack into a base-27 key that indexes a direct-mapped table, grown
+// only to the longest such name seen (27^3 slots for three-letter names).
+// Anything else goes through an open-addressing hash table. Name bytes are
+// copied into a chunked arena, so the views handed out stay valid.
+class NameInterner {
+private:
+  static constexpr std::size_t maxPackedLength{4};
+  static constexpr std::size_t arenaBlockSize{std::size_t{1} << 16};
+
+  // id + 1 per slot, with 0 meaning absent.
+  std::vector<int> m_packed{};
+  std::vector<int> m_slots{};
+  std::vector<std::uint64_t> m_slotHashes{};
+  std::size_t m_hashedCount{0};
+
+  std::vector<std::string_view> m_names{};
+  std::vector<std::unique_ptr<char[]>> m_blocks{};
+  char *m_blockNext{nullptr};
+  std::size_t m_blockFree{0};
+
+  // Little-endian base 27 with digits 1..26, so names of different lengths
+  // never collide and every name of n letters has a key below 27^n. Returns 0
+  // for names that do not pack.
+  static std::size_t packedKey(std::string_view s) {
+    if (s.empty() || s.size() > maxPackedLength) {
+      return 0;
+    }
+    std::size_t key{0};
+    std::size_t scale{1};
+    for (char ch : s) {
+      if (ch < 'a' || ch > 'z') {
+        return 0;
+      }
+      key += static_cast<std::size_t>(ch - 'a' + 1) * scale;
+      scale *= 27;
+    }
+    return key;
+  }
+
+  static std::size_t packedLimit(std::size_t length) {
+    std::size_t limit{1};
+    for (std::size_t i{0}; i < length; ++i) {
+      limit *= 27;
+    }
+    return limit;
+  }
+
+  // FNV-1a.
+  static std::uint64_t hashName(std::string_view s) {
+    std::uint64_t h{14695981039346656037ULL};
+    for (char ch : s) {
+      h ^= static_cast<unsigned char>(ch);
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  std::string_view store(std::string_view s) {
+    if (s.size() > m_blockFree) {
+      // A name longer than a block gets a block of its own.
+      const std::size_t blockSize{std::max(arenaBlockSize, s.size())};
+      m_blocks.push_back(std::make_unique<char[]>(blockSize));
+      m_blockNext = m_blocks.back().get();
+      m_blockFree = blockSize;
+    }
+    char *dest{m_blockNext};
+    std::copy(s.begin(), s.end(), dest);
+    m_blockNext += s.size();
+    m_blockFree -= s.size();
+    return {dest, s.size()};
+  }
+
+  // Slot holding s, or the empty slot where it would go.
+  std::size_t findSlot(std::string_view s, std::uint64_t h) const {
+    const std::size_t mask{m_slots.size() - 1};
+    std::size_t i{static_cast<std::size_t>(h) & mask};
+    while (m_slots[i] != 0 &&
+           (m_slotHashes[i] != h ||
+            m_names[static_cast<std::size_t>(m_slots[i] - 1)] != s)) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  void growSlots() {
+    std::vector<int> oldSlots{};
+    std::vector<std::uint64_t> oldHashes{};
+    oldSlots.swap(m_slots);
+    oldHashes.swap(m_slotHashes);
+
+    const std::size_t capacity{oldSlots.empty() ? 16 : oldSlots.size() * 2};
+    m_slots.assign(capacity, 0);
+    m_slotHashes.assign(capacity, 0);
+    for (std::size_t i{0}; i < oldSlots.size(); ++i) {
+      if (oldSlots[i] != 0) {
+        std::size_t j{static_cast<std::size_t>(oldHashes[i]) & (capacity - 1)};
+        while (m_slots[j] != 0) {
+          j = (j + 1) & (capacity - 1);
+        }
+        m_slots[j] = oldSlots[i];
+        m_slotHashes[j] = oldHashes[i];
+      }
+    }
+  }
+
+public:
+  int size() const { return static_cast<int>(m_names.size()); }
+
+  std::string_view name(int id) const {
+    return m_names[static_cast<std::size_t>(id)];
+  }
+
+  // Id of s, or -1 if it was never interned.
+  int find(std::string_view s) const {
+    if (const std::size_t key{packedKey(s)}; key != 0) {
+      return key < m_packed.size() ? m_packed[key] - 1 : -1;
+    }
+    if (m_slots.empty()) {
+      return -1;
+    }
+    return m_slots[findSlot(s, hashName(s))] - 1;
+  }
+
+  int intern(std::string_view s) {
+    const int newId{size()};
+
+    if (const std::size_t key{packedKey(s)}; key != 0) {
+      if (key >= m_packed.size()) {
+        m_packed.resize(packedLimit(s.size()), 0);
+      }
+      int &slot{m_packed[key]};
+      if (slot == 0) {
+        slot = newId + 1;
+        m_names.push_back(store(s));
+      }
+      return slot - 1;
+    }
+
+    if (2 * (m_hashedCount + 1) > m_slots.size()) {
+      growSlots();
+    }
+    const std::uint64_t h{hashName(s)};
+    const std::size_t i{findSlot(s, h)};
+    if (m_slots[i] == 0) {
+      m_slots[i] = newId + 1;
+      m_slotHashes[i] = h;
+      ++m_hashedCount;
+      m_names.push_back(store(s));
+    }
+    return m_slots[i] - 1;
+  }
+};
+
 struct Graph {
-  std::vector<std::string> name{};
+  NameInterner names{};
   std::vector<std::vector<int>> out{};
-  std::unordered_map<std::string, int> id{};
 
-  int getId(const std::string &s) {
-    auto it{id.find(s)};
-    if (it != id.end()) {
-      return it->second;
+  int getId(std::string_view s) {
+    const int newId{names.intern(s)};
+    if (static_cast<std::size_t>(newId) == out.size()) {
+      out.push_back({});
     }
-    int newId{static_cast<int>(name.size())};
-    id.emplace(s, newId);
-    name.push_back(s);
-    out.push_back({});
     return newId;
   }
 
-  void addEdge(const std::string &u, const std::string &v) {
+  int at(std::string_view s) const {
+    const int found{names.find(s)};
+    if (found < 0) {
+      throw std::runtime_error("Unknown node: " + std::string(s));
+    }
+    return found;
+  }
+
+  void addEdge(std::string_view u, std::string_view v) {
     int a{getId(u)};
     int b{getId(v)};
     out[a].push_back(b);
   }
 };
 
-Graph readInput(const std::string &filename) {
+static bool isBlank(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+// Next blank-separated token of line at or after pos, or an empty view.
+static std::string_view nextToken(std::string_view line, std::size_t &pos) {
+  while (pos < line.size() && isBlank(line[pos])) {
+    ++pos;
+  }
+  const std::size_t begin{pos};
+  while (pos < line.size() && !isBlank(line[pos])) {
+    ++pos;
+  }
+  return line.substr(begin, pos - begin);
+}
+
+// Parses the whole input in place: tokens are views into text, so the only
+// allocations are the graph's own.
+Graph parseInput(std::string_view text) {
   Graph g;
 
-  std::ifstream file(filename);
+  std::size_t lineStart{0};
+  while (lineStart < text.size()) {
+    std::size_t lineEnd{text.find('\n', lineStart)};
+    if (lineEnd == std::string_view::npos) {
+      lineEnd = text.size();
+    }
+    const std::string_view line{text.substr(lineStart, lineEnd - lineStart)};
+    lineStart = lineEnd + 1;
 
-  std::string line;
-  while (std::getline(file, line)) {
-    if (line.empty()) {
+    std::size_t pos{0};
+    std::string_view node{nextToken(line, pos)};
+    if (node.empty()) {
       continue;
     }
+    if (node.back() == ':') {
+      node.remove_suffix(1);
+    }
 
-    std::istringstream iss(line);
+    // Unlike the original reader, which stopped a line at "out" and dropped
+    // the edge, every child is kept as an edge, "out" included. The counts
+    // only stay the same while "out" is the graph's only dead end and is last
+    // on its line, as in the puzzle input; DynamicPathCounts relies on the
+    // edges into "out" being present.
+    g.getId(node);
+    std::string_view child{};
+    while (!(child = nextToken(line, pos)).empty()) {
+      g.addEdge(node, child);
+    }
+  }
+  return g;
+}
 
-    std::string node;
-    iss >> node;
+Graph readInput(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Failed to open file: " + filename);
+  }
+  const std::string bytes{std::istreambuf_iterator<char>{file},
+                          std::istreambuf_iterator<char>{}};
+  return parseInput(bytes);
+}
 
-    if (!node.empty() && node.back() == ':') {
-      node.pop_back();
-    }
+// Graph in compressed sparse row form, with nodes renumbered in topological
+// order: every edge goes from a lower CSR id to a higher one, so a DP over
+// ids in reverse sees all children of a node before the node itself.
+struct CsrGraph {
+  std::vector<int> offsets{};
+  std::vector<int> targets{};
+  // Graph id -> CSR id, and back.
+  std::vector<int> topoId{};
+  std::vector<int> graphId{};
 
-    std::string child;
-    bool hasChild{false};
+  int size() const { return static_cast<int>(graphId.size()); }
 
-    while (iss >> child) {
-      hasChild = true;
-      if (child == "out") {
-        break;
+  int outBegin(int u) const { return offsets[static_cast<std::size_t>(u)]; }
+  int outEnd(int u) const { return offsets[static_cast<std::size_t>(u) + 1]; }
+};
+
+// Kahn's algorithm over g, then a counting-sort style CSR build in the new
+// numbering. Throws if g has a cycle, as path counts are then unbounded.
+CsrGraph buildCsr(const Graph &g) {
+  const std::size_t n{g.out.size()};
+
+  std::vector<int> indegree(n, 0);
+  for (const auto &children : g.out) {
+    for (int v : children) {
+      ++indegree[static_cast<std::size_t>(v)];
+    }
+  }
+
+  CsrGraph csr{};
+  csr.graphId.reserve(n);
+  for (std::size_t u{0}; u < n; ++u) {
+    if (indegree[u] == 0) {
+      csr.graphId.push_back(static_cast<int>(u));
+    }
+  }
+  // graphId doubles as the Kahn queue.
+  for (std::size_t head{0}; head < csr.graphId.size(); ++head) {
+    const int u{csr.graphId[head]};
+    for (int v : g.out[static_cast<std::size_t>(u)]) {
+      if (--indegree[static_cast<std::size_t>(v)] == 0) {
+        csr.graphId.push_back(v);
       }
-      g.addEdge(node, child);
     }
-    if (!hasChild || child == "out") {
-      g.getId(node);
+  }
+  if (csr.graphId.size() != n) {
+    throw std::runtime_error("Graph has a cycle");
+  }
+
+  csr.topoId.assign(n, 0);
+  for (std::size_t i{0}; i < n; ++i) {
+    csr.topoId[static_cast<std::size_t>(csr.graphId[i])] = static_cast<int>(i);
+  }
+
+  csr.offsets.assign(n + 1, 0);
+  for (std::size_t i{0}; i < n; ++i) {
+    const auto &children{g.out[static_cast<std::size_t>(csr.graphId[i])]};
+    csr.offsets[i + 1] = csr.offsets[i] + static_cast<int>(children.size());
+  }
+
+  csr.targets.resize(static_cast<std::size_t>(csr.offsets[n]));
+  for (std::size_t i{0}; i < n; ++i) {
+    const auto &children{g.out[static_cast<std::size_t>(csr.graphId[i])]};
+    auto first{csr.targets.begin() + csr.offsets[i]};
+    auto it{first};
+    for (int v : children) {
+      *it++ = csr.topoId[static_cast<std::size_t>(v)];
     }
+    // Ascending targets keep the DP's reads moving forward through memory.
+    std::sort(first, it);
   }
-  return g;
+
+  return csr;
+}
+
+// Fills ways[u] from the already computed counts of u's children.
+static void countWaysNode(const CsrGraph &csr, int u,
+                          std::vector<long long> &ways) {
+  const int begin{csr.outBegin(u)};
+  const int end{csr.outEnd(u)};
+  if (begin == end) {
+    ways[static_cast<std::size_t>(u)] = 1;
+    return;
+  }
+  long long total{0};
+  for (int e{begin}; e < end; ++e) {
+    total += ways[static_cast<std::size_t>(
+        csr.targets[static_cast<std::size_t>(e)])];
+  }
+  ways[static_cast<std::size_t>(u)] = total;
+}
+
+// Path counts from every node to a leaf, indexed by CSR id. Same recurrence
+// as countWays, but one linear pass with no recursion.
+std::vector<long long> countWaysAll(const CsrGraph &csr) {
+  const int n{csr.size()};
+  std::vector<long long> ways(static_cast<std::size_t>(n), 0);
+
+  for (int u{n - 1}; u >= 0; --u) {
+    countWaysNode(csr, u, ways);
+  }
+
+  return ways;
 }
 
 long long countWays(int u, const Graph &g, std::vector<long long> &memo) {
@@ -116,25 +413,560 @@ long long countWays2(int u, int a, int b, int mask, const Graph &g,
   return total;
 }
 
+// Required waypoints for the mask DP are capped so that the [node][2^k]
+// table stays a sensible size.
+constexpr int maxMaskWaypoints{16};
+
+// Layout of the flat [node][2^k] table, plus each node's own waypoint bit.
+struct MaskLayout {
+  std::size_t width{0};
+  std::uint32_t full{0U};
+  std::vector<std::uint32_t> bitOf{};
+};
+
+static MaskLayout makeMaskLayout(const CsrGraph &csr,
+                                 const std::vector<int> &waypoints) {
+  const int k{static_cast<int>(waypoints.size())};
+  if (k > maxMaskWaypoints) {
+    throw std::runtime_error("Too many waypoints for the mask DP");
+  }
+
+  MaskLayout layout{};
+  layout.width = std::size_t{1} << k;
+  layout.full = static_cast<std::uint32_t>(layout.width - 1);
+  layout.bitOf.assign(static_cast<std::size_t>(csr.size()), 0U);
+  for (int i{0}; i < k; ++i) {
+    layout.bitOf[static_cast<std::size_t>(
+        waypoints[static_cast<std::size_t>(i)])] |= 1U << i;
+  }
+  return layout;
+}
+
+// Fills row u of the mask table from the rows of u's children.
+static void countWaysMaskNode(const CsrGraph &csr, int u,
+                              const MaskLayout &layout,
+                              std::vector<long long> &table) {
+  const std::size_t width{layout.width};
+  const std::size_t row{static_cast<std::size_t>(u) * width};
+  const std::uint32_t own{layout.bitOf[static_cast<std::size_t>(u)]};
+  const int begin{csr.outBegin(u)};
+  const int end{csr.outEnd(u)};
+
+  for (std::uint32_t m{0}; m <= layout.full; ++m) {
+    const std::uint32_t seen{m | own};
+    if (seen != m) {
+      // Entering u sets its bit, so this entry equals the one with it set.
+      continue;
+    }
+    long long total{0};
+    if (begin == end) {
+      total = (seen == layout.full) ? 1 : 0;
+    }
+    for (int e{begin}; e < end; ++e) {
+      const std::size_t v{
+          static_cast<std::size_t>(csr.targets[static_cast<std::size_t>(e)])};
+      total += table[v * width + seen];
+    }
+    table[row + m] = total;
+  }
+  if (own != 0U) {
+    for (std::uint32_t m{0}; m <= layout.full; ++m) {
+      table[row + m] = table[row + (m | own)];
+    }
+  }
+}
+
+// Flat [node][2^k] table: entry (u, m) counts the paths from u to a leaf that,
+// together with the waypoints in m already passed, visit every waypoint.
+// Column 0 is therefore the answer for a path starting at u. Waypoints are
+// CSR ids.
+std::vector<long long> countWaysMaskTable(const CsrGraph &csr,
+                                          const std::vector<int> &waypoints) {
+  const MaskLayout layout{makeMaskLayout(csr, waypoints)};
+  const int n{csr.size()};
+
+  std::vector<long long> table(static_cast<std::size_t>(n) * layout.width, 0);
+  for (int u{n - 1}; u >= 0; --u) {
+    countWaysMaskNode(csr, u, layout, table);
+  }
+
+  return table;
+}
+
+// Paths from `from` to `to`, or to any leaf when `to` is -1. Only the ids from
+// `from` through `to` can lie on such a path, and ways[] is left zeroed there
+// for the next call.
+static long long countPathsBetween(const CsrGraph &csr, int from, int to,
+                                   std::vector<long long> &ways) {
+  const int last{to < 0 ? csr.size() - 1 : to};
+  if (from > last) {
+    return 0;
+  }
+
+  for (int u{last}; u >= from; --u) {
+    const int begin{csr.outBegin(u)};
+    const int end{csr.outEnd(u)};
+    long long total{0};
+    if (u == to || (to < 0 && begin == end)) {
+      total = 1;
+    } else {
+      for (int e{begin}; e < end; ++e) {
+        const int v{csr.targets[static_cast<std::size_t>(e)]};
+        if (v > last) {
+          // Targets are sorted, so the rest are past `to` as well.
+          break;
+        }
+        total += ways[static_cast<std::size_t>(v)];
+      }
+    }
+    ways[static_cast<std::size_t>(u)] = total;
+  }
+
+  const long long result{ways[static_cast<std::size_t>(from)]};
+  std::fill(ways.begin() + from, ways.begin() + last + 1, 0);
+  return result;
+}
+
+// Paths from start to a leaf that visit every waypoint (all CSR ids). In a DAG
+// a path meets the waypoints in increasing topological id, so the count
+// splits into a product of segment counts start -> w1 -> ... -> wk -> leaf.
+// Those segments cover disjoint id ranges, so one query is a single linear
+// pass. The mask table costs 2^k times that, so it is only worth building to
+// answer every start node at once.
+long long countWaysThrough(const CsrGraph &csr, int start,
+                           std::vector<int> waypoints) {
+  std::sort(waypoints.begin(), waypoints.end());
+  waypoints.erase(std::unique(waypoints.begin(), waypoints.end()),
+                  waypoints.end());
+
+  std::vector<long long> ways(static_cast<std::size_t>(csr.size()), 0);
+  long long total{1};
+  int from{start};
+  for (int w : waypoints) {
+    total *= countPathsBetween(csr, from, w, ways);
+    if (total == 0) {
+      return 0;
+    }
+    from = w;
+  }
+  return total * countPathsBetween(csr, from, -1, ways);
+}
+
+class ThreadPool {
+private:
+  std::vector<std::thread> m_workers{};
+  std::deque<std::function<void()>> m_tasks{};
+  std::size_t m_busy{0};
+  bool m_stopping{false};
+  std::mutex m_mutex{};
+  std::condition_variable m_taskReady{};
+  std::condition_variable m_idle{};
+
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task{};
+      {
+        std::unique_lock lock{m_mutex};
+        m_taskReady.wait(lock,
+                         [this]() { return m_stopping || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+          return;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        ++m_busy;
+      }
+
+      task();
+
+      std::lock_guard lock{m_mutex};
+      --m_busy;
+      if (m_busy == 0 && m_tasks.empty()) {
+        m_idle.notify_all();
+      }
+    }
+  }
+
+public:
+  explicit ThreadPool(unsigned threadCount) {
+    threadCount = std::max(1U, threadCount);
+    for (unsigned i{0}; i < threadCount; ++i) {
+      m_workers.emplace_back([this]() { workerLoop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock{m_mutex};
+      m_stopping = true;
+    }
+    m_taskReady.notify_all();
+    for (std::thread &worker : m_workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard lock{m_mutex};
+      m_tasks.push_back(std::move(task));
+    }
+    m_taskReady.notify_one();
+  }
+
+  void wait() {
+    std::unique_lock lock{m_mutex};
+    m_idle.wait(lock, [this]() { return m_busy == 0 && m_tasks.empty(); });
+  }
+};
+
+// Nodes bucketed by their longest distance to a leaf. Every child of a node
+// sits in a strictly lower level, so the nodes of one level are independent
+// once the levels below are done.
+struct SinkLevels {
+  std::vector<int> offsets{};
+  std::vector<int> nodes{};
+
+  int count() const { return static_cast<int>(offsets.size()) - 1; }
+};
+
+SinkLevels sinkLevels(const CsrGraph &csr) {
+  const int n{csr.size()};
+  std::vector<int> level(static_cast<std::size_t>(n), 0);
+  int maxLevel{0};
+
+  for (int u{n - 1}; u >= 0; --u) {
+    int depth{-1};
+    for (int e{csr.outBegin(u)}; e < csr.outEnd(u); ++e) {
+      depth = std::max(depth, level[static_cast<std::size_t>(
+                                  csr.targets[static_cast<std::size_t>(e)])]);
+    }
+    level[static_cast<std::size_t>(u)] = depth + 1;
+    maxLevel = std::max(maxLevel, depth + 1);
+  }
+
+  SinkLevels levels{};
+  levels.offsets.assign(static_cast<std::size_t>(maxLevel) + 2, 0);
+  for (int l : level) {
+    ++levels.offsets[static_cast<std::size_t>(l) + 1];
+  }
+  for (std::size_t i{1}; i < levels.offsets.size(); ++i) {
+    levels.offsets[i] += levels.offsets[i - 1];
+  }
+
+  levels.nodes.resize(static_cast<std::size_t>(n));
+  std::vector<int> fill(levels.offsets.begin(), levels.offsets.end() - 1);
+  for (std::size_t u{0}; u < level.size(); ++u) {
+    int &next{fill[static_cast<std::size_t>(level[u])]};
+    levels.nodes[static_cast<std::size_t>(next++)] = static_cast<int>(u);
+  }
+  return levels;
+}
+
+// Runs nodeFn on every node, level by level from the leaves up. A level is cut
+// into chunks of grainSize nodes for the pool; levels no bigger than one chunk
+// run on the calling thread, as the hand-off would cost more than the work.
+// Each node is written by exactly one task, so results do not depend on the
+// thread count or the schedule.
+template <typename NodeFn>
+static void forEachLevel(const SinkLevels &levels, ThreadPool &pool,
+                         std::size_t grainSize, NodeFn nodeFn) {
+  grainSize = std::max<std::size_t>(1, grainSize);
+
+  for (int l{0}; l < levels.count(); ++l) {
+    const std::size_t begin{
+        static_cast<std::size_t>(levels.offsets[static_cast<std::size_t>(l)])};
+    const std::size_t end{static_cast<std::size_t>(
+        levels.offsets[static_cast<std::size_t>(l) + 1])};
+
+    if (end - begin <= grainSize) {
+      for (std::size_t i{begin}; i < end; ++i) {
+        nodeFn(levels.nodes[i]);
+      }
+      continue;
+    }
+
+    for (std::size_t chunk{begin}; chunk < end; chunk += grainSize) {
+      const std::size_t chunkEnd{std::min(end, chunk + grainSize)};
+      pool.submit([&levels, &nodeFn, chunk, chunkEnd]() {
+        for (std::size_t i{chunk}; i < chunkEnd; ++i) {
+          nodeFn(levels.nodes[i]);
+        }
+      });
+    }
+    pool.wait();
+  }
+}
+
+// countWaysAll, with each level's nodes spread over the pool.
+std::vector<long long> countWaysAllParallel(const CsrGraph &csr,
+                                            ThreadPool &pool,
+                                            std::size_t grainSize = 1024) {
+  std::vector<long long> ways(static_cast<std::size_t>(csr.size()), 0);
+  forEachLevel(sinkLevels(csr), pool, grainSize,
+               [&csr, &ways](int u) { countWaysNode(csr, u, ways); });
+  return ways;
+}
+
+// countWaysMaskTable, with each level's rows spread over the pool.
+std::vector<long long>
+countWaysMaskTableParallel(const CsrGraph &csr,
+                           const std::vector<int> &waypoints, ThreadPool &pool,
+                           std::size_t grainSize = 256) {
+  const MaskLayout layout{makeMaskLayout(csr, waypoints)};
+  std::vector<long long> table(
+      static_cast<std::size_t>(csr.size()) * layout.width, 0);
+  forEachLevel(sinkLevels(csr), pool, grainSize,
+               [&csr, &layout, &table](int u) {
+                 countWaysMaskNode(csr, u, layout, table);
+               });
+  return table;
+}
+
+// Path counts to "out" for every node, kept current while edges are added
+// and removed. A topological position per node is maintained with the
+// Pearce-Kelly algorithm, which only reorders the nodes between the two ends
+// of an edge that goes backwards. After an edge change at u, counts are redone
+// from u towards its ancestors in decreasing position, and only parents of
+// nodes whose count actually changed are visited, so an update costs time in
+// the affected subgraph rather than the whole graph.
+//
+// Unlike countWays, only "out" counts as one path; any other node left with
+// no children counts as none.
+class DynamicPathCounts {
+private:
+  Graph m_graph{};
+  int m_sink{0};
+  std::vector<std::vector<int>> m_in{};
+  std::vector<int> m_order{};
+  std::vector<long long> m_ways{};
+
+  // Scratch reused between updates.
+  std::vector<char> m_mark{};
+  std::vector<int> m_stack{};
+  std::vector<int> m_forward{};
+  std::vector<int> m_backward{};
+  std::vector<int> m_positions{};
+
+  int nodeId(std::string_view name) {
+    const int id{m_graph.getId(name)};
+    if (static_cast<std::size_t>(id) == m_order.size()) {
+      // A new node has no edges, so it can go last in the order.
+      m_in.push_back({});
+      m_order.push_back(id);
+      m_ways.push_back(0);
+      m_mark.push_back(0);
+    }
+    return id;
+  }
+
+  long long recount(int u) const {
+    if (u == m_sink) {
+      return 1;
+    }
+    long long total{0};
+    const auto &children{m_graph.out[static_cast<std::size_t>(u)]};
+    for (int v : children) {
+      total += m_ways[static_cast<std::size_t>(v)];
+    }
+    return total;
+  }
+
+  void clearMarks(const std::vector<int> &nodes) {
+    for (int x : nodes) {
+      m_mark[static_cast<std::size_t>(x)] = 0;
+    }
+  }
+
+  // Makes room for a new edge u -> v when v is currently ordered before u.
+  // Returns false, leaving the order untouched, if the edge closes a cycle.
+  bool reorder(int u, int v) {
+    const int lower{m_order[static_cast<std::size_t>(v)]};
+    const int upper{m_order[static_cast<std::size_t>(u)]};
+
+    // Nodes reachable from v that sit before u.
+    m_forward.clear();
+    m_stack.assign(1, v);
+    m_mark[static_cast<std::size_t>(v)] = 1;
+    while (!m_stack.empty()) {
+      const int x{m_stack.back()};
+      m_stack.pop_back();
+      m_forward.push_back(x);
+      for (int y : m_graph.out[static_cast<std::size_t>(x)]) {
+        if (y == u) {
+          clearMarks(m_forward);
+          clearMarks(m_stack);
+          return false;
+        }
+        if (!m_mark[static_cast<std::size_t>(y)] &&
+            m_order[static_cast<std::size_t>(y)] < upper) {
+          m_mark[static_cast<std::size_t>(y)] = 1;
+          m_stack.push_back(y);
+        }
+      }
+    }
+
+    // Nodes that reach u and sit after v.
+    m_backward.clear();
+    m_stack.assign(1, u);
+    m_mark[static_cast<std::size_t>(u)] = 1;
+    while (!m_stack.empty()) {
+      const int x{m_stack.back()};
+      m_stack.pop_back();
+      m_backward.push_back(x);
+      for (int y : m_in[static_cast<std::size_t>(x)]) {
+        if (!m_mark[static_cast<std::size_t>(y)] &&
+            m_order[static_cast<std::size_t>(y)] > lower) {
+          m_mark[static_cast<std::size_t>(y)] = 1;
+          m_stack.push_back(y);
+        }
+      }
+    }
+    clearMarks(m_forward);
+    clearMarks(m_backward);
+
+    // Hand the same positions back out, ancestors of u first.
+    const auto byOrder{[this](int a, int b) {
+      return m_order[static_cast<std::size_t>(a)] <
+             m_order[static_cast<std::size_t>(b)];
+    }};
+    std::sort(m_forward.begin(), m_forward.end(), byOrder);
+    std::sort(m_backward.begin(), m_backward.end(), byOrder);
+
+    m_positions.clear();
+    for (int x : m_backward) {
+      m_positions.push_back(m_order[static_cast<std::size_t>(x)]);
+    }
+    for (int x : m_forward) {
+      m_positions.push_back(m_order[static_cast<std::size_t>(x)]);
+    }
+    std::sort(m_positions.begin(), m_positions.end());
+
+    std::size_t next{0};
+    for (int x : m_backward) {
+      m_order[static_cast<std::size_t>(x)] = m_positions[next++];
+    }
+    for (int x : m_forward) {
+      m_order[static_cast<std::size_t>(x)] = m_positions[next++];
+    }
+    return true;
+  }
+
+  // Recounts u and then, latest position first, every ancestor whose count
+  // can have changed.
+  void propagateFrom(int u) {
+    std::priority_queue<std::pair<int, int>> pending{};
+    pending.emplace(m_order[static_cast<std::size_t>(u)], u);
+    m_mark[static_cast<std::size_t>(u)] = 1;
+
+    while (!pending.empty()) {
+      const int x{pending.top().second};
+      pending.pop();
+      m_mark[static_cast<std::size_t>(x)] = 0;
+
+      const long long updated{recount(x)};
+      if (updated == m_ways[static_cast<std::size_t>(x)]) {
+        continue;
+      }
+      m_ways[static_cast<std::size_t>(x)] = updated;
+      for (int p : m_in[static_cast<std::size_t>(x)]) {
+        if (!m_mark[static_cast<std::size_t>(p)]) {
+          m_mark[static_cast<std::size_t>(p)] = 1;
+          pending.emplace(m_order[static_cast<std::size_t>(p)], p);
+        }
+      }
+    }
+  }
+
+public:
+  explicit DynamicPathCounts(Graph g) : m_graph{std::move(g)} {
+    m_sink = m_graph.getId("out");
+    const CsrGraph csr{buildCsr(m_graph)};
+    const std::size_t n{m_graph.out.size()};
+
+    m_in.assign(n, {});
+    for (std::size_t u{0}; u < n; ++u) {
+      for (int v : m_graph.out[u]) {
+        m_in[static_cast<std::size_t>(v)].push_back(static_cast<int>(u));
+      }
+    }
+    m_order = csr.topoId;
+    m_ways.assign(n, 0);
+    for (auto it{csr.graphId.rbegin()}; it != csr.graphId.rend(); ++it) {
+      m_ways[static_cast<std::size_t>(*it)] = recount(*it);
+    }
+    m_mark.assign(n, 0);
+  }
+
+  const Graph &graph() const { return m_graph; }
+
+  long long ways(std::string_view name) const {
+    return m_ways[static_cast<std::size_t>(m_graph.at(name))];
+  }
+
+  // Adds the edge u -> v, creating either node if needed. Returns false, and
+  // leaves the graph unchanged, if the edge would create a cycle.
+  bool addEdge(std::string_view uName, std::string_view vName) {
+    const int u{nodeId(uName)};
+    const int v{nodeId(vName)};
+    if (u == v) {
+      return false;
+    }
+    if (m_order[static_cast<std::size_t>(u)] >
+            m_order[static_cast<std::size_t>(v)] &&
+        !reorder(u, v)) {
+      return false;
+    }
+
+    m_graph.out[static_cast<std::size_t>(u)].push_back(v);
+    m_in[static_cast<std::size_t>(v)].push_back(u);
+    propagateFrom(u);
+    return true;
+  }
+
+  // Removes one u -> v edge. Returns false if there is none.
+  bool removeEdge(std::string_view uName, std::string_view vName) {
+    const int u{m_graph.names.find(uName)};
+    const int v{m_graph.names.find(vName)};
+    if (u < 0 || v < 0) {
+      return false;
+    }
+
+    auto &children{m_graph.out[static_cast<std::size_t>(u)]};
+    auto child{std::find(children.begin(), children.end(), v)};
+    if (child == children.end()) {
+      return false;
+    }
+    children.erase(child);
+
+    auto &parents{m_in[static_cast<std::size_t>(v)]};
+    parents.erase(std::find(parents.begin(), parents.end(), u));
+
+    // Removing an edge never invalidates the topological order.
+    propagateFrom(u);
+    return true;
+  }
+};
+
 int main() {
   Graph g{readInput("input.txt")};
 
-  int start{g.id.at("you")};
-  std::vector<long long> memo(g.name.size(), -1);
-  long long ways(countWays(start, g, memo));
+  const CsrGraph csr{buildCsr(g)};
+  const std::vector<long long> allWays{countWaysAll(csr)};
 
-  std::cout << ways << '\n';
+  int start{g.at("you")};
+  long long ways{allWays[static_cast<std::size_t>(csr.topoId[start])]};
 
-  int start2{g.id.at("svr")};
-  int dac{g.id.at("dac")};
-  int fft{g.id.at("fft")};
-  std::vector<std::vector<long long>> memo2(g.name.size());
+  std::cout << ways << '\n';
 
-  for (auto &row : memo2) {
-    row = std::vector<long long>{-1, -1, -1, -1};
-  };
+  int start2{csr.topoId[g.at("svr")]};
+  int dac{csr.topoId[g.at("dac")]};
+  int fft{csr.topoId[g.at("fft")]};
 
-  long long ways2(countWays2(start2, dac, fft, 0, g, memo2));
+  long long ways2{countWaysThrough(csr, start2, {dac, fft})};
   std::cout << ways2 << '\n';
 
   return 0;
@@ -1,8 +1,12 @@
+#include <algorithm>
+#include <cctype>
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -228,28 +232,380 @@ long long operate2(const std::vector<std::string> &v,
   return globalResult;
 }
 
-int main() {
-  std::string filename{"input.txt"};
+// Unsigned multi-limb integer, base 2^32, least significant limb first.
+class BigUInt {
+private:
+  std::vector<std::uint32_t> m_limbs{};
+
+  void trim() {
+    while (!m_limbs.empty() && m_limbs.back() == 0U) {
+      m_limbs.pop_back();
+    }
+  }
+
+public:
+  BigUInt() = default;
+  explicit BigUInt(unsigned __int128 value) {
+    while (value != 0) {
+      m_limbs.push_back(static_cast<std::uint32_t>(value));
+      value >>= 32;
+    }
+  }
+
+  BigUInt &operator+=(const BigUInt &other) {
+    if (m_limbs.size() < other.m_limbs.size()) {
+      m_limbs.resize(other.m_limbs.size(), 0U);
+    }
+
+    std::uint64_t carry{0};
+    for (std::size_t i{0}; i < m_limbs.size(); ++i) {
+      std::uint64_t sum{carry + m_limbs[i]};
+      if (i < other.m_limbs.size()) {
+        sum += other.m_limbs[i];
+      }
+      m_limbs[i] = static_cast<std::uint32_t>(sum);
+      carry = sum >> 32;
+    }
+    if (carry != 0) {
+      m_limbs.push_back(static_cast<std::uint32_t>(carry));
+    }
+    return *this;
+  }
+
+  BigUInt &operator*=(const BigUInt &other) {
+    if (m_limbs.empty() || other.m_limbs.empty()) {
+      m_limbs.clear();
+      return *this;
+    }
+
+    std::vector<std::uint32_t> product(m_limbs.size() + other.m_limbs.size(),
+                                       0U);
+
+    for (std::size_t i{0}; i < m_limbs.size(); ++i) {
+      std::uint64_t carry{0};
+      for (std::size_t j{0}; j < other.m_limbs.size(); ++j) {
+        std::uint64_t cur{static_cast<std::uint64_t>(m_limbs[i]) *
+                              other.m_limbs[j] +
+                          product[i + j] + carry};
+        product[i + j] = static_cast<std::uint32_t>(cur);
+        carry = cur >> 32;
+      }
+      product[i + other.m_limbs.size()] = static_cast<std::uint32_t>(carry);
+    }
+
+    m_limbs = std::move(product);
+    trim();
+    return *this;
+  }
+
+  std::string toString() const {
+    if (m_limbs.empty()) {
+      return "0";
+    }
+
+    std::vector<std::uint32_t> digits{m_limbs};
+    std::string out{};
+
+    while (!digits.empty()) {
+      std::uint64_t rem{0};
+      for (std::size_t i{digits.size()}; i-- > 0;) {
+        std::uint64_t cur{(rem << 32) | digits[i]};
+        digits[i] = static_cast<std::uint32_t>(cur / 1000000000U);
+        rem = cur % 1000000000U;
+      }
+      while (!digits.empty() && digits.back() == 0U) {
+        digits.pop_back();
+      }
+
+      for (int k{0}; k < 9; ++k) {
+        out.push_back(static_cast<char>('0' + rem % 10));
+        rem /= 10;
+        if (digits.empty() && rem == 0) {
+          break;
+        }
+      }
+    }
+
+    std::reverse(out.begin(), out.end());
+    return out;
+  }
+};
+
+// Non-negative integer that starts as a long long and only promotes to
+// __int128, then BigUInt, when a checked add or multiply overflows.
+class WideInt {
+private:
+  enum class Tier {
+    Small,
+    Wide,
+    Big,
+  };
+
+  Tier m_tier{Tier::Small};
+  long long m_small{0};
+  __int128 m_wide{0};
+  BigUInt m_big{};
+
+  void promote(Tier tier) {
+    if (m_tier == Tier::Small && tier != Tier::Small) {
+      m_wide = m_small;
+      m_tier = Tier::Wide;
+    }
+    if (m_tier == Tier::Wide && tier == Tier::Big) {
+      m_big = BigUInt{static_cast<unsigned __int128>(m_wide)};
+      m_tier = Tier::Big;
+    }
+  }
+
+  static WideInt promoted(const WideInt &value, Tier tier) {
+    WideInt copy{value};
+    copy.promote(tier);
+    return copy;
+  }
+
+public:
+  WideInt() = default;
+  explicit WideInt(long long value) : m_small{value} {}
+
+  WideInt &operator+=(const WideInt &other) {
+    promote(std::max(m_tier, other.m_tier));
+    const WideInt rhs{promoted(other, m_tier)};
+
+    long long small{};
+    if (m_tier == Tier::Small &&
+        !__builtin_add_overflow(m_small, rhs.m_small, &small)) {
+      m_small = small;
+      return *this;
+    }
+    promote(Tier::Wide);
+    __int128 wide{};
+    if (m_tier == Tier::Wide &&
+        !__builtin_add_overflow(m_wide, promoted(rhs, Tier::Wide).m_wide,
+                                &wide)) {
+      m_wide = wide;
+      return *this;
+    }
+    promote(Tier::Big);
+    m_big += promoted(rhs, Tier::Big).m_big;
+    return *this;
+  }
+
+  WideInt &operator*=(const WideInt &other) {
+    promote(std::max(m_tier, other.m_tier));
+    const WideInt rhs{promoted(other, m_tier)};
+
+    long long small{};
+    if (m_tier == Tier::Small &&
+        !__builtin_mul_overflow(m_small, rhs.m_small, &small)) {
+      m_small = small;
+      return *this;
+    }
+    promote(Tier::Wide);
+    __int128 wide{};
+    if (m_tier == Tier::Wide &&
+        !__builtin_mul_overflow(m_wide, promoted(rhs, Tier::Wide).m_wide,
+                                &wide)) {
+      m_wide = wide;
+      return *this;
+    }
+    promote(Tier::Big);
+    m_big *= promoted(rhs, Tier::Big).m_big;
+    return *this;
+  }
+
+  std::string toString() const {
+    switch (m_tier) {
+    case Tier::Small:
+      return std::to_string(m_small);
+    case Tier::Wide:
+      return BigUInt{static_cast<unsigned __int128>(m_wide)}.toString();
+    case Tier::Big:
+      return m_big.toString();
+    }
+    return "?";
+  }
+};
+
+struct WorksheetProblem {
+  char opr{'+'};
+  std::vector<WideInt> nums{};
+};
+
+WideInt evaluateProblem(const WorksheetProblem &problem) {
+  WideInt result{problem.opr == '*' ? 1 : 0};
+
+  for (const WideInt &num : problem.nums) {
+    if (problem.opr == '*') {
+      result *= num;
+    } else {
+      result += num;
+    }
+  }
+  return result;
+}
+
+// Same right-to-left column walk as operate2, but each block between
+// bookmarks becomes its own problem instead of being folded in place.
+std::vector<WorksheetProblem>
+splitProblems(const std::vector<std::string> &v, const std::vector<char> &c,
+              const std::unordered_set<int> &bm) {
+
+  const int str_len = static_cast<int>(v[0].size());
+  std::vector<WorksheetProblem> problems{};
+
+  int opr_indx = static_cast<int>(c.size()) - 1;
+  WorksheetProblem current{c[opr_indx], {}};
+
+  for (int str_pos{str_len - 1}; str_pos >= 0; --str_pos) {
+
+    if (bm.contains(str_pos)) {
+      if (!current.nums.empty()) {
+        problems.push_back(std::move(current));
+      }
+
+      if (opr_indx > 0) {
+        --opr_indx;
+      }
+      current = WorksheetProblem{c[opr_indx], {}};
+      continue;
+    }
+
+    WideInt localNum{0};
+
+    for (std::size_t i{0}; i < v.size(); ++i) {
+      char ch = (str_pos < static_cast<int>(v[i].size())) ? v[i][str_pos] : ' ';
+
+      if (ch == ' ') {
+        continue;
+      }
+      localNum *= WideInt{10};
+      localNum += WideInt{ch - '0'};
+    }
+
+    current.nums.push_back(localNum);
+  }
+
+  if (!current.nums.empty()) {
+    problems.push_back(std::move(current));
+  }
+
+  return problems;
+}
+
+// Problems are independent, so each thread evaluates a contiguous slice and
+// the partial results are summed in problem order afterwards.
+WideInt evaluateWorksheet(const std::vector<WorksheetProblem> &problems,
+                          unsigned threadCount) {
+  const std::size_t n{problems.size()};
+  std::vector<WideInt> results(n);
+
+  threadCount = std::max(1U, std::min<unsigned>(threadCount, n));
+  const std::size_t chunk{(n + threadCount - 1) / threadCount};
+
+  std::vector<std::thread> workers{};
+  workers.reserve(threadCount);
+
+  for (unsigned t{0}; t < threadCount; ++t) {
+    const std::size_t begin{std::min(n, t * chunk)};
+    const std::size_t end{std::min(n, begin + chunk)};
+
+    workers.emplace_back([&problems, &results, begin, end]() {
+      for (std::size_t i{begin}; i < end; ++i) {
+        results[i] = evaluateProblem(problems[i]);
+      }
+    });
+  }
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
 
-  /* std::vector<std::vector<int>>
-  matrix_t{transpose(readInputNumbers(filename))}; std::vector<char>
-  operations{readInputOperations(filename)};
+  WideInt globalResult{0};
+  for (const WideInt &result : results) {
+    globalResult += result;
+  }
 
-  std::size_t rows{matrix_t.size()};
+  return globalResult;
+}
 
-  long long result{0};
+// Part 1 in a single pass: every column keeps both a sum and a product lane
+// while the number rows stream past, and the operator row picks one of them.
+WideInt streamPart1(const std::string &filename) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open file");
+  }
+
+  std::vector<WideInt> sums{};
+  std::vector<WideInt> products{};
+  WideInt result{0};
+  std::string line{};
 
-  for (size_t i{0}; i < rows; ++i) {
-    result += operate(matrix_t[i], operations[i]);
+  while (std::getline(file, line)) {
+    std::size_t col{0};
+    std::size_t i{0};
+    bool operatorRow{false};
+
+    while (i < line.size()) {
+      if (std::isspace(static_cast<unsigned char>(line[i]))) {
+        ++i;
+        continue;
+      }
+
+      if (line[i] == '+' || line[i] == '*') {
+        operatorRow = true;
+        if (col < sums.size()) {
+          result += (line[i] == '+') ? sums[col] : products[col];
+        }
+        ++col;
+        ++i;
+        continue;
+      }
+
+      if (line[i] < '0' || line[i] > '9') {
+        throw std::runtime_error("Unexpected character in worksheet: " +
+                                 std::string(1, line[i]));
+      }
+
+      WideInt value{0};
+      while (i < line.size() && line[i] >= '0' && line[i] <= '9') {
+        value *= WideInt{10};
+        value += WideInt{line[i] - '0'};
+        ++i;
+      }
+
+      if (col == sums.size()) {
+        sums.emplace_back(0);
+        products.emplace_back(1);
+      }
+      sums[col] += value;
+      products[col] *= value;
+      ++col;
+    }
+
+    if (operatorRow) {
+      break;
+    }
   }
 
-  std::cout << "Part 1: " << result << '\n';
-*/
+  return result;
+}
+
+int main() {
+  std::string filename{"input.txt"};
+
+  std::cout << "Part 1: " << streamPart1(filename).toString() << '\n';
 
   std::vector<std::string> inputVector{readInput2(filename)};
   std::vector<char> operations{readInputOperations(filename)};
   std::unordered_set<int> bm{findBookMark(inputVector)};
 
-  std::cout << operate2(inputVector, operations, bm) << '\n';
+  std::vector<WorksheetProblem> problems{
+      splitProblems(inputVector, operations, bm)};
+
+  std::cout << "Part 2: "
+            << evaluateWorksheet(problems, std::thread::hardware_concurrency())
+                   .toString()
+            << '\n';
   return 0;
 }
@@ -1,9 +1,19 @@
+#include <algorithm>
+#include <bit>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 enum class CellType {
@@ -50,9 +60,106 @@ Position operator+(Position a, Position b) {
   return Position{a.row + b.row, a.col + b.col};
 }
 
+// One bit per column, packed into 64-bit words (column c is bit c % 64 of
+// word c / 64). Bits past m_cols in the last word are always kept clear.
+class BitRow {
+private:
+  std::vector<std::uint64_t> m_words{};
+  int m_cols{};
+
+public:
+  BitRow() = default;
+  explicit BitRow(int cols)
+      : m_words(static_cast<std::size_t>((cols + 63) / 64), 0U), m_cols{cols} {
+  }
+
+  int size() const { return m_cols; }
+
+  bool test(int c) const { return (m_words[c / 64] >> (c % 64)) & 1U; }
+  void set(int c) { m_words[c / 64] |= std::uint64_t{1} << (c % 64); }
+
+  bool any() const {
+    for (std::uint64_t word : m_words) {
+      if (word != 0U) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int count() const {
+    int total{0};
+    for (std::uint64_t word : m_words) {
+      total += std::popcount(word);
+    }
+    return total;
+  }
+
+  template <typename F> void forEachSet(F f) const {
+    for (std::size_t w{0}; w < m_words.size(); ++w) {
+      std::uint64_t word{m_words[w]};
+      while (word != 0U) {
+        f(static_cast<int>(w * 64) + std::countr_zero(word));
+        word &= word - 1;
+      }
+    }
+  }
+
+  // Copies cols columns of src, starting at the word-aligned column
+  // firstCol, into this row (reusing its storage).
+  void assignSlice(const BitRow &src, int firstCol, int cols) {
+    const auto first{src.m_words.begin() + firstCol / 64};
+    m_words.assign(first, first + (cols + 63) / 64);
+    m_cols = cols;
+    if (cols % 64 != 0) {
+      m_words.back() &= (std::uint64_t{1} << (cols % 64)) - 1;
+    }
+  }
+
+  // Overwrites cols columns starting at firstCol with those of src starting
+  // at srcFirstCol. Both starting columns must be word-aligned.
+  void copyColumns(int firstCol, const BitRow &src, int srcFirstCol,
+                   int cols) {
+    const auto first{src.m_words.begin() + srcFirstCol / 64};
+    std::copy(first, first + (cols + 63) / 64,
+              m_words.begin() + firstCol / 64);
+  }
+
+  // beam = (beam & ~split) | ((beam & split) << 1) | ((beam & split) >> 1),
+  // done in place a word at a time. Returns the number of beams that hit a
+  // splitter within words [countFrom, countTo).
+  int propagate(const BitRow &split, std::size_t countFrom = 0,
+                std::size_t countTo = SIZE_MAX) {
+    const std::size_t n{m_words.size()};
+    int splits{0};
+    std::uint64_t prevHit{0};
+    std::uint64_t hit{n > 0 ? m_words[0] & split.m_words[0] : 0U};
+
+    for (std::size_t w{0}; w < n; ++w) {
+      const std::uint64_t nextHit{
+          w + 1 < n ? m_words[w + 1] & split.m_words[w + 1] : 0U};
+
+      if (w >= countFrom && w < countTo) {
+        splits += std::popcount(hit);
+      }
+      m_words[w] = (m_words[w] & ~split.m_words[w]) | (hit << 1) |
+                   (prevHit >> 63) | (hit >> 1) | (nextHit << 63);
+
+      prevHit = hit;
+      hit = nextHit;
+    }
+
+    if (n > 0 && m_cols % 64 != 0) {
+      m_words[n - 1] &= (std::uint64_t{1} << (m_cols % 64)) - 1;
+    }
+    return splits;
+  }
+};
+
 class Map {
 private:
   std::vector<std::vector<Cell>> m_cells{};
+  std::vector<BitRow> m_splitters{};
   int m_rows{};
   int m_cols{};
   Position m_start{};
@@ -62,6 +169,7 @@ private:
     m_cols = m_rows > 0 ? static_cast<int>(lines[0].size()) : 0;
 
     m_cells.resize(m_rows, std::vector<Cell>(m_cols));
+    m_splitters.assign(m_rows, BitRow{m_cols});
     for (int r{0}; r < m_rows; ++r) {
       const std::string &line{lines[r]};
       for (int c{0}; c < m_cols; ++c) {
@@ -75,6 +183,7 @@ private:
           break;
         case '^':
           type = CellType::Splitter;
+          m_splitters[r].set(c);
           break;
         case '|':
           type = CellType::Beam;
@@ -116,9 +225,32 @@ public:
     m_cells[pos.row][pos.col].setType(type);
   }
   const Cell &getCell(int r, int c) const { return m_cells[r][c]; }
+  const BitRow &getSplitterRow(int r) const { return m_splitters[r]; }
 
   Position getStart() const { return m_start; }
 
+  // Timelines for a beam entering each column on the start row, computed
+  // bottom-up in one pass: a beam below the last row is one timeline, and a
+  // splitter's value is the sum of its two neighbours one row further down.
+  std::vector<std::uint64_t> timelinesByEntryColumn() const {
+    std::vector<std::uint64_t> ways(static_cast<std::size_t>(m_cols), 1U);
+    std::vector<std::pair<int, std::uint64_t>> updates{};
+
+    for (int r{m_rows - 1}; r > m_start.row; --r) {
+      updates.clear();
+      m_splitters[r].forEachSet([this, &ways, &updates](int c) {
+        std::uint64_t left{c > 0 ? ways[c - 1] : 0U};
+        std::uint64_t right{c + 1 < m_cols ? ways[c + 1] : 0U};
+        updates.emplace_back(c, left + right);
+      });
+
+      for (const auto &[c, k] : updates) {
+        ways[c] = k;
+      }
+    }
+    return ways;
+  }
+
   void print() const {
     for (int r{0}; r < m_rows; ++r) {
       for (int c{0}; c < m_cols; ++c) {
@@ -170,6 +302,329 @@ void simulateBeams(Map &map, int &splitCount) {
   }
 }
 
+// Same result as simulateBeams, but each row is advanced a word (64 columns)
+// at a time and nothing is printed or written back into the map.
+int simulateBeamsBitset(const Map &map) {
+  BitRow beam{map.getCols()};
+  beam.set(map.getStart().col);
+
+  int splitCount{0};
+  for (int r{map.getStart().row + 1}; r < map.getRows(); ++r) {
+    splitCount += beam.propagate(map.getSplitterRow(r));
+  }
+  return splitCount;
+}
+
+// Carries per-column timeline counts through one row of splitters. A
+// splitter hands its column's count to both neighbours; counts that would
+// leave the map are dropped. hits is scratch space reused between rows.
+void propagateCounts(std::vector<std::uint64_t> &counts, const BitRow &split,
+                     std::vector<std::pair<int, std::uint64_t>> &hits) {
+  const int cols{static_cast<int>(counts.size())};
+
+  hits.clear();
+  split.forEachSet([&counts, &hits](int c) {
+    if (counts[c] != 0U) {
+      hits.emplace_back(c, counts[c]);
+      counts[c] = 0;
+    }
+  });
+
+  for (const auto &[c, k] : hits) {
+    if (c > 0) {
+      counts[c - 1] += k;
+    }
+    if (c + 1 < cols) {
+      counts[c + 1] += k;
+    }
+  }
+}
+
+std::uint64_t sumCounts(const std::vector<std::uint64_t> &counts) {
+  std::uint64_t total{0};
+  for (std::uint64_t k : counts) {
+    total += k;
+  }
+  return total;
+}
+
+// One timeline count per column, carried down the map a row at a time.
+std::uint64_t countTimelinesDP(const Map &map) {
+  std::vector<std::uint64_t> counts(static_cast<std::size_t>(map.getCols()),
+                                    0U);
+  counts[map.getStart().col] = 1;
+
+  std::vector<std::pair<int, std::uint64_t>> hits{};
+
+  for (int r{map.getStart().row + 1}; r < map.getRows(); ++r) {
+    propagateCounts(counts, map.getSplitterRow(r), hits);
+  }
+  return sumCounts(counts);
+}
+
+struct ParsedRow {
+  BitRow splitters{};
+  int start{-1};
+};
+
+// Bounded hand-off between the parsing thread and the simulation, so at
+// most m_capacity rows are ever held in memory.
+class RowQueue {
+private:
+  std::deque<ParsedRow> m_rows{};
+  std::size_t m_capacity{};
+  bool m_closed{false};
+  std::mutex m_mutex{};
+  std::condition_variable m_notEmpty{};
+  std::condition_variable m_notFull{};
+
+public:
+  explicit RowQueue(std::size_t capacity) : m_capacity{capacity} {}
+
+  void push(ParsedRow row) {
+    std::unique_lock lock{m_mutex};
+    m_notFull.wait(lock, [this]() { return m_rows.size() < m_capacity; });
+    m_rows.push_back(std::move(row));
+    m_notEmpty.notify_one();
+  }
+
+  void close() {
+    std::lock_guard lock{m_mutex};
+    m_closed = true;
+    m_notEmpty.notify_one();
+  }
+
+  bool pop(ParsedRow &row) {
+    std::unique_lock lock{m_mutex};
+    m_notEmpty.wait(lock, [this]() { return !m_rows.empty() || m_closed; });
+    if (m_rows.empty()) {
+      return false;
+    }
+    row = std::move(m_rows.front());
+    m_rows.pop_front();
+    m_notFull.notify_one();
+    return true;
+  }
+};
+
+struct SimulationResult {
+  long long splitCount{0};
+  std::uint64_t timelines{0};
+};
+
+// Simulates the manifold without ever holding the whole map: one thread
+// parses rows into splitter bitsets while this one advances the beam row
+// and the per-column timeline counts. Memory is O(width).
+SimulationResult simulateStream(const std::string &filename,
+                                std::size_t queueDepth = 64) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open file: " + filename);
+  }
+
+  RowQueue queue{queueDepth};
+
+  std::thread parser([&file, &queue]() {
+    std::string line{};
+    int cols{-1};
+
+    while (std::getline(file, line)) {
+      if (line.empty()) {
+        continue;
+      }
+      if (cols < 0) {
+        cols = static_cast<int>(line.size());
+      }
+
+      ParsedRow row{BitRow{cols}, -1};
+      const int width{std::min(cols, static_cast<int>(line.size()))};
+      for (int c{0}; c < width; ++c) {
+        if (line[c] == '^') {
+          row.splitters.set(c);
+        } else if (line[c] == 'S') {
+          row.start = c;
+        }
+      }
+      queue.push(std::move(row));
+    }
+    queue.close();
+  });
+
+  SimulationResult result{};
+  BitRow beam{};
+  std::vector<std::uint64_t> counts{};
+  std::vector<std::pair<int, std::uint64_t>> hits{};
+  bool started{false};
+  ParsedRow row{};
+
+  while (queue.pop(row)) {
+    if (!started) {
+      if (row.start >= 0) {
+        beam = BitRow{row.splitters.size()};
+        beam.set(row.start);
+        counts.assign(static_cast<std::size_t>(row.splitters.size()), 0U);
+        counts[row.start] = 1;
+        started = true;
+      }
+      continue;
+    }
+
+    result.splitCount += beam.propagate(row.splitters);
+    propagateCounts(counts, row.splitters, hits);
+  }
+
+  parser.join();
+
+  result.timelines = sumCounts(counts);
+  return result;
+}
+
+// Fixed set of worker threads draining a shared task queue.
+class ThreadPool {
+private:
+  std::vector<std::thread> m_workers{};
+  std::deque<std::function<void()>> m_tasks{};
+  std::size_t m_busy{0};
+  bool m_stopping{false};
+  std::mutex m_mutex{};
+  std::condition_variable m_taskReady{};
+  std::condition_variable m_idle{};
+
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task{};
+      {
+        std::unique_lock lock{m_mutex};
+        m_taskReady.wait(lock,
+                         [this]() { return m_stopping || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+          return;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        ++m_busy;
+      }
+
+      task();
+
+      std::lock_guard lock{m_mutex};
+      --m_busy;
+      if (m_busy == 0 && m_tasks.empty()) {
+        m_idle.notify_all();
+      }
+    }
+  }
+
+public:
+  explicit ThreadPool(unsigned threadCount) {
+    threadCount = std::max(1U, threadCount);
+    for (unsigned i{0}; i < threadCount; ++i) {
+      m_workers.emplace_back([this]() { workerLoop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock{m_mutex};
+      m_stopping = true;
+    }
+    m_taskReady.notify_all();
+    for (std::thread &worker : m_workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard lock{m_mutex};
+      m_tasks.push_back(std::move(task));
+    }
+    m_taskReady.notify_one();
+  }
+
+  void wait() {
+    std::unique_lock lock{m_mutex};
+    m_idle.wait(lock, [this]() { return m_busy == 0 && m_tasks.empty(); });
+  }
+};
+
+// Parallel simulateBeamsBitset + countTimelinesDP for very wide maps. The
+// map is cut into vertical strips of stripCols columns and processed
+// blockRows rows at a time. A beam moves at most one column per row, so a
+// strip simulated together with a halo of blockRows columns on each side
+// has exact interior columns at the end of the block; only those are
+// written back, and the halos are re-read from the merged row next block.
+SimulationResult simulateStrips(const Map &map, ThreadPool &pool,
+                                int stripCols = 4096, int blockRows = 256) {
+  const int cols{map.getCols()};
+  const int rows{map.getRows()};
+
+  stripCols = std::max(64, (stripCols + 63) / 64 * 64);
+  blockRows = std::max(1, blockRows);
+  const int halo{(blockRows + 63) / 64 * 64};
+  const int strips{(cols + stripCols - 1) / stripCols};
+
+  BitRow beam{cols};
+  beam.set(map.getStart().col);
+  std::vector<std::uint64_t> counts(static_cast<std::size_t>(cols), 0U);
+  counts[map.getStart().col] = 1;
+
+  BitRow nextBeam{cols};
+  std::vector<std::uint64_t> nextCounts(counts.size(), 0U);
+  std::vector<long long> stripSplits(static_cast<std::size_t>(strips), 0);
+
+  SimulationResult result{};
+
+  for (int r0{map.getStart().row + 1}; r0 < rows; r0 += blockRows) {
+    const int r1{std::min(rows, r0 + blockRows)};
+
+    for (int s{0}; s < strips; ++s) {
+      pool.submit([&, s]() {
+        const int a{s * stripCols};
+        const int b{std::min(cols, a + stripCols)};
+        const int ha{std::max(0, a - halo)};
+        const int hb{std::min(cols, b + halo)};
+
+        BitRow localBeam{};
+        localBeam.assignSlice(beam, ha, hb - ha);
+        std::vector<std::uint64_t> localCounts(counts.begin() + ha,
+                                               counts.begin() + hb);
+        BitRow localSplit{};
+        std::vector<std::pair<int, std::uint64_t>> hits{};
+
+        const std::size_t firstWord{static_cast<std::size_t>((a - ha) / 64)};
+        const std::size_t lastWord{
+            static_cast<std::size_t>((b - ha + 63) / 64)};
+        long long splits{0};
+
+        for (int r{r0}; r < r1; ++r) {
+          localSplit.assignSlice(map.getSplitterRow(r), ha, hb - ha);
+          splits += localBeam.propagate(localSplit, firstWord, lastWord);
+          propagateCounts(localCounts, localSplit, hits);
+        }
+
+        nextBeam.copyColumns(a, localBeam, a - ha, b - a);
+        std::copy(localCounts.begin() + (a - ha),
+                  localCounts.begin() + (b - ha), nextCounts.begin() + a);
+        stripSplits[s] = splits;
+      });
+    }
+    pool.wait();
+
+    for (long long splits : stripSplits) {
+      result.splitCount += splits;
+    }
+    std::swap(beam, nextBeam);
+    std::swap(counts, nextCounts);
+  }
+
+  result.timelines = sumCounts(counts);
+  return result;
+}
+
 long long edgeFinder(int r, int c,
                      const std::vector<std::vector<std::size_t>> &nodeLoc,
                      std::vector<std::vector<long long>> &memo) {
@@ -296,25 +751,12 @@ void printSplitterColumns(
 
 int main() {
   Map map{"test.txt"};
-  int splitCount{0};
-
-  simulateBeams(map, splitCount);
-
-  std::vector<std::vector<std::size_t>> nodeLoc{extractSplitterLocation(map)};
-
-  if (!nodeLoc.empty()) {
-    int cols{map.getCols()};
-    std::vector<std::size_t> ghostRow{buildGhostBottomRow(nodeLoc, cols)};
-    nodeLoc.push_back(std::move(ghostRow));
-  }
+  int splitCount{simulateBeamsBitset(map)};
 
   std::cout << "\nThe beam splits " << splitCount << " times\n";
-  ;
-
-  // printSplitterColumns(nodeLoc);
 
   std::cout << "\nIn the many worlds interpretation there exist "
-            << countTimelines(nodeLoc) << " timelines\n";
+            << countTimelinesDP(map) << " timelines\n";
 
   return 0;
 }
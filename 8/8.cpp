@@ -1,15 +1,25 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <climits>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <ios>
 #include <iostream>
 #include <istream>
 #include <iterator>
+#include <queue>
+#include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -17,21 +27,24 @@ class UnionFind {
 
 private:
   std::vector<std::size_t> parent;
-  std::vector<std::size_t> rank;
-  int setCount;
+  std::vector<std::size_t> setSize;
+  std::size_t setCount;
 
 public:
-  explicit UnionFind(std::size_t n) : parent(n), rank(n, 0), setCount(n) {
+  explicit UnionFind(std::size_t n) : parent(n), setSize(n, 1), setCount(n) {
     for (std::size_t i{0}; i < n; ++i) {
       parent[i] = i;
     }
   }
 
+  // Iterative, with path halving: every visited node is re-pointed at its
+  // grandparent.
   std::size_t find(std::size_t x) {
-    if (parent[x] != x) {
-      parent[x] = find(parent[x]);
+    while (parent[x] != x) {
+      parent[x] = parent[parent[x]];
+      x = parent[x];
     }
-    return parent[x];
+    return x;
   }
 
   bool unite(size_t a, size_t b) {
@@ -42,22 +55,196 @@ public:
       return false;
     }
 
-    if (rank[rootA] < rank[rootB]) {
-      parent[rootA] = rootB;
-    } else if (rank[rootA] > rank[rootB]) {
-      parent[rootB] = rootA;
-    } else {
-      parent[rootB] = rootA;
-      rank[rootA] += 1;
+    if (setSize[rootA] < setSize[rootB]) {
+      std::swap(rootA, rootB);
     }
+    parent[rootB] = rootA;
+    setSize[rootA] += setSize[rootB];
 
     --setCount;
     return true;
   }
 
-  bool same(int a, int b) { return find(a) == find(b); }
+  bool same(std::size_t a, std::size_t b) { return find(a) == find(b); }
+
+  std::size_t countSets() const { return setCount; }
+
+  std::size_t componentSize(std::size_t x) { return setSize[find(x)]; }
 
-  int countSets() { return setCount; }
+  // Dense ids 0..countSets()-1, numbered in order of each component's first
+  // element.
+  std::vector<std::size_t> componentIds() {
+    const std::size_t n{parent.size()};
+    const std::size_t unassigned{n};
+    std::vector<std::size_t> rootId(n, unassigned);
+    std::vector<std::size_t> ids(n);
+    std::size_t nextId{0};
+
+    for (std::size_t k{0}; k < n; ++k) {
+      std::size_t &id{rootId[find(k)]};
+      if (id == unassigned) {
+        id = nextId++;
+      }
+      ids[k] = id;
+    }
+    return ids;
+  }
+
+  // histogram[s] is the number of components with exactly s elements.
+  std::vector<std::size_t> sizeHistogram() const {
+    std::vector<std::size_t> histogram(parent.size() + 1, 0);
+    for (std::size_t k{0}; k < parent.size(); ++k) {
+      if (parent[k] == k) {
+        ++histogram[setSize[k]];
+      }
+    }
+    return histogram;
+  }
+
+  // Sizes of the k largest components, largest first, in O(n).
+  std::vector<std::size_t> largestSizes(std::size_t k) const {
+    const std::vector<std::size_t> histogram{sizeHistogram()};
+    std::vector<std::size_t> sizes{};
+    sizes.reserve(std::min(k, setCount));
+
+    for (std::size_t s{histogram.size()}; s-- > 1 && sizes.size() < k;) {
+      for (std::size_t c{0}; c < histogram[s] && sizes.size() < k; ++c) {
+        sizes.push_back(s);
+      }
+    }
+    return sizes;
+  }
+};
+
+// UnionFind that many threads can use at once. parent links always point
+// from a lower to a higher index, so unite links the lower root under the
+// higher with one CAS and no cycle can form; find does path halving with
+// CAS and simply moves on if another thread got there first. Without
+// union-by-size, componentIds and the size queries scan every element and
+// must only be called while no unite is in flight.
+class ConcurrentUnionFind {
+
+private:
+  std::vector<std::atomic<std::size_t>> parent;
+  std::atomic<std::size_t> setCount;
+
+public:
+  explicit ConcurrentUnionFind(std::size_t n) : parent(n), setCount(n) {
+    for (std::size_t i{0}; i < n; ++i) {
+      parent[i].store(i, std::memory_order_relaxed);
+    }
+  }
+
+  std::size_t find(std::size_t x) {
+    while (true) {
+      std::size_t p{parent[x].load(std::memory_order_acquire)};
+      if (p == x) {
+        return x;
+      }
+      std::size_t grandparent{parent[p].load(std::memory_order_acquire)};
+      if (grandparent != p) {
+        parent[x].compare_exchange_weak(p, grandparent,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed);
+      }
+      x = grandparent;
+    }
+  }
+
+  bool unite(std::size_t a, std::size_t b) {
+    while (true) {
+      std::size_t rootA{find(a)};
+      std::size_t rootB{find(b)};
+
+      if (rootA == rootB) {
+        return false;
+      }
+      if (rootA > rootB) {
+        std::swap(rootA, rootB);
+      }
+
+      std::size_t expected{rootA};
+      if (parent[rootA].compare_exchange_strong(expected, rootB,
+                                                std::memory_order_acq_rel)) {
+        setCount.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+
+  bool same(std::size_t a, std::size_t b) {
+    while (true) {
+      std::size_t rootA{find(a)};
+      std::size_t rootB{find(b)};
+      if (rootA == rootB) {
+        return true;
+      }
+      // rootA may have been linked under something since it was found.
+      if (parent[rootA].load(std::memory_order_acquire) == rootA) {
+        return false;
+      }
+    }
+  }
+
+  std::size_t countSets() const {
+    return setCount.load(std::memory_order_relaxed);
+  }
+
+  std::vector<std::size_t> componentIds() {
+    const std::size_t n{parent.size()};
+    const std::size_t unassigned{n};
+    std::vector<std::size_t> rootId(n, unassigned);
+    std::vector<std::size_t> ids(n);
+    std::size_t nextId{0};
+
+    for (std::size_t k{0}; k < n; ++k) {
+      std::size_t &id{rootId[find(k)]};
+      if (id == unassigned) {
+        id = nextId++;
+      }
+      ids[k] = id;
+    }
+    return ids;
+  }
+
+  std::size_t componentSize(std::size_t x) {
+    const std::size_t root{find(x)};
+    std::size_t size{0};
+    for (std::size_t k{0}; k < parent.size(); ++k) {
+      if (find(k) == root) {
+        ++size;
+      }
+    }
+    return size;
+  }
+
+  std::vector<std::size_t> sizeHistogram() {
+    std::vector<std::size_t> rootSize(parent.size(), 0);
+    for (std::size_t k{0}; k < parent.size(); ++k) {
+      ++rootSize[find(k)];
+    }
+
+    std::vector<std::size_t> histogram(parent.size() + 1, 0);
+    for (std::size_t size : rootSize) {
+      if (size != 0) {
+        ++histogram[size];
+      }
+    }
+    return histogram;
+  }
+
+  std::vector<std::size_t> largestSizes(std::size_t k) {
+    const std::vector<std::size_t> histogram{sizeHistogram()};
+    std::vector<std::size_t> sizes{};
+    sizes.reserve(std::min(k, countSets()));
+
+    for (std::size_t s{histogram.size()}; s-- > 1 && sizes.size() < k;) {
+      for (std::size_t c{0}; c < histogram[s] && sizes.size() < k; ++c) {
+        sizes.push_back(s);
+      }
+    }
+    return sizes;
+  }
 };
 
 struct junctionBox {
@@ -69,7 +256,74 @@ struct junctionBox {
 };
 
 long long distance(const junctionBox &a, const junctionBox &b) {
-  return (pow((a.x - b.x), 2) + pow((a.y - b.y), 2) + pow((a.z - b.z), 2));
+  const long long dx{static_cast<long long>(a.x) - b.x};
+  const long long dy{static_cast<long long>(a.y) - b.y};
+  const long long dz{static_cast<long long>(a.z) - b.z};
+  return dx * dx + dy * dy + dz * dz;
+}
+
+// Box coordinates as separate x/y/z arrays, so the distance loops below read
+// three contiguous int32 streams instead of striding over junctionBox.
+struct BoxCoords {
+  std::vector<std::int32_t> x{};
+  std::vector<std::int32_t> y{};
+  std::vector<std::int32_t> z{};
+
+  explicit BoxCoords(const std::vector<junctionBox> &boxes)
+      : x(boxes.size()), y(boxes.size()), z(boxes.size()) {
+    for (std::size_t k{0}; k < boxes.size(); ++k) {
+      x[k] = boxes[k].x;
+      y[k] = boxes[k].y;
+      z[k] = boxes[k].z;
+    }
+  }
+
+  std::size_t size() const { return x.size(); }
+};
+
+// out[j - jBegin] = squared distance from box i to box j, for j in
+// [jBegin, jEnd). Exact int64 arithmetic in a branch-free loop, vectorisable
+// at -O3 on AVX2/AVX-512 targets.
+void squaredDistanceRow(const BoxCoords &coords, std::size_t i,
+                        std::size_t jBegin, std::size_t jEnd,
+                        std::int64_t *out) {
+  const std::int64_t xi{coords.x[i]};
+  const std::int64_t yi{coords.y[i]};
+  const std::int64_t zi{coords.z[i]};
+  const std::int32_t *xs{coords.x.data() + jBegin};
+  const std::int32_t *ys{coords.y.data() + jBegin};
+  const std::int32_t *zs{coords.z.data() + jBegin};
+  const std::size_t count{jEnd - jBegin};
+
+  for (std::size_t k{0}; k < count; ++k) {
+    const std::int64_t dx{xi - xs[k]};
+    const std::int64_t dy{yi - ys[k]};
+    const std::int64_t dz{zi - zs[k]};
+    out[k] = dx * dx + dy * dy + dz * dz;
+  }
+}
+
+// Calls f(i, jBegin, jEnd, d) over the lower triangle (j < i) of rows
+// [iBegin, iEnd), where d[k] is the squared distance from box i to box
+// jBegin + k. Rows and columns are blocked into tiles so a tile's j
+// coordinates stay in cache while every row of the tile reuses them.
+template <typename F>
+void forEachDistanceTile(const BoxCoords &coords, std::size_t iBegin,
+                         std::size_t iEnd, F f) {
+  constexpr std::size_t tileSize{256};
+  std::array<std::int64_t, tileSize> d{};
+
+  for (std::size_t ib{iBegin}; ib < iEnd; ib += tileSize) {
+    const std::size_t ie{std::min(iEnd, ib + tileSize)};
+
+    for (std::size_t jb{0}; jb + 1 < ie; jb += tileSize) {
+      for (std::size_t i{std::max(ib, jb + 1)}; i < ie; ++i) {
+        const std::size_t je{std::min(i, jb + tileSize)};
+        squaredDistanceRow(coords, i, jb, je, d.data());
+        f(i, jb, je, d.data());
+      }
+    }
+  }
 }
 
 std::vector<junctionBox> readBoxes(const std::string &filename) {
@@ -108,19 +362,22 @@ struct Triples {
 std::vector<Triples> sortDistance(const std::vector<junctionBox> &boxes) {
 
   std::size_t n{boxes.size()};
+  if (n < 2) {
+    return {};
+  }
 
-  std::vector<Triples> distances;
-  distances.reserve(0.5 * n * (n - 1));
+  const BoxCoords coords{boxes};
+  std::vector<Triples> distances(n * (n - 1) / 2);
+
+  forEachDistanceTile(coords, 0, n,
+                      [&distances](std::size_t i, std::size_t jBegin,
+                                   std::size_t jEnd, const std::int64_t *d) {
+                        Triples *row{distances.data() + i * (i - 1) / 2};
+                        for (std::size_t j{jBegin}; j < jEnd; ++j) {
+                          row[j] = Triples{i, j, d[j - jBegin]};
+                        }
+                      });
 
-  for (std::size_t i{0}; i < n; ++i) {
-    for (std::size_t j{0}; (j < n) && (i > j); ++j) {
-      distances.emplace_back(Triples{
-          i,
-          j,
-          distance(boxes[i], boxes[j]),
-      });
-    }
-  }
   std::sort(distances.begin(), distances.end(),
             [](const Triples &a, const Triples &b) {
               return a.distance < b.distance;
@@ -129,9 +386,507 @@ std::vector<Triples> sortDistance(const std::vector<junctionBox> &boxes) {
   return distances;
 }
 
-std::vector<Triples> buildCircuits(std::vector<junctionBox> &boxes,
-                                   const std::vector<Triples> &sortedDistances,
-                                   std::size_t numConnections) {
+// Splits [0, count) into one contiguous range per thread and runs
+// f(thread, begin, end) on each, returning once all have finished.
+template <typename F>
+void parallelFor(std::size_t count, unsigned threadCount, F f) {
+  threadCount = std::max(1U, threadCount);
+  const std::size_t chunk{(count + threadCount - 1) / threadCount};
+
+  std::vector<std::thread> workers{};
+  workers.reserve(threadCount);
+
+  for (unsigned t{0}; t < threadCount; ++t) {
+    const std::size_t begin{std::min(count, t * chunk)};
+    const std::size_t end{std::min(count, begin + chunk)};
+    workers.emplace_back([&f, t, begin, end]() { f(t, begin, end); });
+  }
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+// Every pair (i, j), i > j, packed into one 64-bit key: squared distance in
+// the high bits, then i, then j. Sorting the keys as plain integers gives
+// ascending (distance, i, j) order at 8 bytes per pair instead of 24.
+class PackedEdges {
+private:
+  std::vector<std::uint64_t> m_keys{};
+  unsigned m_indexBits{0};
+
+public:
+  PackedEdges(const std::vector<junctionBox> &boxes, unsigned threadCount) {
+    const std::size_t n{boxes.size()};
+    if (n < 2) {
+      return;
+    }
+
+    m_indexBits = static_cast<unsigned>(std::bit_width(n - 1));
+    m_keys.resize(n * (n - 1) / 2);
+
+    // Rows are split so each thread gets about the same number of pairs;
+    // row i holds its i pairs from offset i * (i - 1) / 2.
+    threadCount = std::max(1U, threadCount);
+    std::vector<std::size_t> rowStart(threadCount + 1, n);
+    for (unsigned t{0}; t < threadCount; ++t) {
+      double share{static_cast<double>(t) / threadCount};
+      rowStart[t] = std::min(n, static_cast<std::size_t>(std::sqrt(share) * n));
+    }
+
+    const BoxCoords coords{boxes};
+    std::vector<std::int64_t> partMax(threadCount, 0);
+    parallelFor(threadCount, threadCount,
+                [&](unsigned, std::size_t lo, std::size_t hi) {
+                  for (std::size_t part{lo}; part < hi; ++part) {
+                    std::int64_t maxDistance{0};
+                    forEachDistanceTile(
+                        coords, rowStart[part], rowStart[part + 1],
+                        [&](std::size_t i, std::size_t jBegin,
+                            std::size_t jEnd, const std::int64_t *d) {
+                          std::uint64_t *row{m_keys.data() + i * (i - 1) / 2};
+                          for (std::size_t j{jBegin}; j < jEnd; ++j) {
+                            maxDistance = std::max(maxDistance, d[j - jBegin]);
+                            row[j] = static_cast<std::uint64_t>(d[j - jBegin]);
+                          }
+                        });
+                    partMax[part] = maxDistance;
+                  }
+                });
+
+    const std::int64_t maxDistance{
+        *std::max_element(partMax.begin(), partMax.end())};
+    if (std::bit_width(static_cast<std::uint64_t>(maxDistance)) +
+            2 * m_indexBits >
+        64) {
+      throw std::runtime_error("Too many boxes to pack edges into 64 bits");
+    }
+
+    parallelFor(threadCount, threadCount,
+                [&](unsigned, std::size_t lo, std::size_t hi) {
+                  for (std::size_t part{lo}; part < hi; ++part) {
+                    for (std::size_t i{rowStart[part]}; i < rowStart[part + 1];
+                         ++i) {
+                      std::uint64_t *row{m_keys.data() + i * (i - 1) / 2};
+                      for (std::size_t j{0}; j < i; ++j) {
+                        row[j] = (row[j] << (2 * m_indexBits)) |
+                                 (i << m_indexBits) | j;
+                      }
+                    }
+                  }
+                });
+  }
+
+  std::size_t size() const { return m_keys.size(); }
+
+  Triples operator[](std::size_t k) const {
+    const std::uint64_t key{m_keys[k]};
+    const std::uint64_t indexMask{(std::uint64_t{1} << m_indexBits) - 1};
+    return Triples{static_cast<std::size_t>((key >> m_indexBits) & indexMask),
+                   static_cast<std::size_t>(key & indexMask),
+                   static_cast<long long>(key >> (2 * m_indexBits))};
+  }
+
+  // LSD radix sort on 8-bit digits, skipping digits above the largest key.
+  // Each pass has every thread histogram its own slice, then scatter it to
+  // offsets that keep the pass stable.
+  void sort(unsigned threadCount) {
+    constexpr int radix{256};
+    const std::size_t n{m_keys.size()};
+    if (n < 2) {
+      return;
+    }
+    threadCount = std::max(1U, threadCount);
+
+    const std::uint64_t maxKey{
+        *std::max_element(m_keys.begin(), m_keys.end())};
+    const int passes{static_cast<int>((std::bit_width(maxKey) + 7) / 8)};
+
+    std::vector<std::uint64_t> buffer(n);
+    std::vector<std::array<std::size_t, radix>> counts(threadCount);
+
+    for (int pass{0}; pass < passes; ++pass) {
+      const int shift{8 * pass};
+
+      parallelFor(n, threadCount, [&](unsigned t, std::size_t lo,
+                                      std::size_t hi) {
+        counts[t].fill(0);
+        for (std::size_t k{lo}; k < hi; ++k) {
+          ++counts[t][(m_keys[k] >> shift) & (radix - 1)];
+        }
+      });
+
+      std::size_t offset{0};
+      for (int digit{0}; digit < radix; ++digit) {
+        for (unsigned t{0}; t < threadCount; ++t) {
+          std::size_t c{counts[t][digit]};
+          counts[t][digit] = offset;
+          offset += c;
+        }
+      }
+
+      parallelFor(n, threadCount, [&](unsigned t, std::size_t lo,
+                                      std::size_t hi) {
+        std::array<std::size_t, radix> &next{counts[t]};
+        for (std::size_t k{lo}; k < hi; ++k) {
+          buffer[next[(m_keys[k] >> shift) & (radix - 1)]++] = m_keys[k];
+        }
+      });
+
+      m_keys.swap(buffer);
+    }
+  }
+};
+
+PackedEdges sortDistancePacked(const std::vector<junctionBox> &boxes,
+                               unsigned threadCount) {
+  PackedEdges edges{boxes, threadCount};
+  edges.sort(threadCount);
+  return edges;
+}
+
+// Static 3-d tree over the boxes, laid out implicitly: the node for the
+// index range [lo, hi) is its midpoint, split on axis depth % 3.
+class KdTree {
+private:
+  static constexpr std::size_t m_mixed{SIZE_MAX};
+  static constexpr std::size_t m_empty{SIZE_MAX - 1};
+
+  const std::vector<junctionBox> &m_boxes;
+  std::vector<std::size_t> m_order{};
+  // Component shared by every box under the node at this position, or
+  // m_mixed. Filled by labelComponents.
+  std::vector<std::size_t> m_subtreeComponent{};
+
+  static int coord(const junctionBox &box, int axis) {
+    return axis == 0 ? box.x : (axis == 1 ? box.y : box.z);
+  }
+
+  void build(std::size_t lo, std::size_t hi, int axis) {
+    if (hi - lo <= 1) {
+      return;
+    }
+    std::size_t mid{lo + (hi - lo) / 2};
+    std::nth_element(m_order.begin() + lo, m_order.begin() + mid,
+                     m_order.begin() + hi,
+                     [this, axis](std::size_t a, std::size_t b) {
+                       return coord(m_boxes[a], axis) <
+                              coord(m_boxes[b], axis);
+                     });
+    build(lo, mid, (axis + 1) % 3);
+    build(mid + 1, hi, (axis + 1) % 3);
+  }
+
+  // best is a max-heap on (distance, index) holding at most k entries.
+  void search(std::size_t lo, std::size_t hi, int axis, std::size_t query,
+              std::size_t k,
+              std::vector<std::pair<long long, std::size_t>> &best) const {
+    if (lo >= hi) {
+      return;
+    }
+    std::size_t mid{lo + (hi - lo) / 2};
+    std::size_t p{m_order[mid]};
+
+    if (p != query) {
+      std::pair<long long, std::size_t> cand{
+          distance(m_boxes[p], m_boxes[query]), p};
+      if (best.size() < k || cand < best.front()) {
+        best.push_back(cand);
+        std::push_heap(best.begin(), best.end());
+        if (best.size() > k) {
+          std::pop_heap(best.begin(), best.end());
+          best.pop_back();
+        }
+      }
+    }
+
+    long long diff{static_cast<long long>(coord(m_boxes[query], axis)) -
+                   coord(m_boxes[p], axis)};
+    int next{(axis + 1) % 3};
+
+    if (diff < 0) {
+      search(lo, mid, next, query, k, best);
+    } else {
+      search(mid + 1, hi, next, query, k, best);
+    }
+
+    if (best.size() < k || diff * diff <= best.front().first) {
+      if (diff < 0) {
+        search(mid + 1, hi, next, query, k, best);
+      } else {
+        search(lo, mid, next, query, k, best);
+      }
+    }
+  }
+
+  std::size_t labelRange(std::size_t lo, std::size_t hi,
+                         const std::vector<std::size_t> &component) {
+    if (lo >= hi) {
+      return m_empty;
+    }
+    std::size_t mid{lo + (hi - lo) / 2};
+    std::size_t label{component[m_order[mid]]};
+
+    for (std::size_t child : {labelRange(lo, mid, component),
+                              labelRange(mid + 1, hi, component)}) {
+      if (child != m_empty && child != label) {
+        label = m_mixed;
+      }
+    }
+    m_subtreeComponent[mid] = label;
+    return label;
+  }
+
+  // Like search with k = 1, but only boxes outside the query's component
+  // count, and subtrees entirely inside it are skipped.
+  void searchOutside(std::size_t lo, std::size_t hi, int axis,
+                     std::size_t query,
+                     const std::vector<std::size_t> &component,
+                     std::pair<long long, std::size_t> &best) const {
+    if (lo >= hi) {
+      return;
+    }
+    std::size_t mid{lo + (hi - lo) / 2};
+    if (m_subtreeComponent[mid] == component[query]) {
+      return;
+    }
+    std::size_t p{m_order[mid]};
+
+    if (component[p] != component[query]) {
+      std::pair<long long, std::size_t> cand{
+          distance(m_boxes[p], m_boxes[query]), p};
+      best = std::min(best, cand);
+    }
+
+    long long diff{static_cast<long long>(coord(m_boxes[query], axis)) -
+                   coord(m_boxes[p], axis)};
+    int next{(axis + 1) % 3};
+
+    if (diff < 0) {
+      searchOutside(lo, mid, next, query, component, best);
+    } else {
+      searchOutside(mid + 1, hi, next, query, component, best);
+    }
+
+    if (diff * diff <= best.first) {
+      if (diff < 0) {
+        searchOutside(mid + 1, hi, next, query, component, best);
+      } else {
+        searchOutside(lo, mid, next, query, component, best);
+      }
+    }
+  }
+
+public:
+  explicit KdTree(const std::vector<junctionBox> &boxes)
+      : m_boxes{boxes}, m_order(boxes.size()) {
+    for (std::size_t i{0}; i < m_order.size(); ++i) {
+      m_order[i] = i;
+    }
+    build(0, m_order.size(), 0);
+  }
+
+  // The k nearest boxes to boxes[query] (excluding itself), ordered by
+  // (distance, index).
+  std::vector<std::pair<long long, std::size_t>> nearest(std::size_t query,
+                                                         std::size_t k) const {
+    std::vector<std::pair<long long, std::size_t>> best{};
+    best.reserve(k + 1);
+    search(0, m_order.size(), 0, query, k, best);
+    std::sort_heap(best.begin(), best.end());
+    return best;
+  }
+
+  // Records which subtrees lie entirely within one component, for
+  // nearestOutside. component[k] is box k's component id.
+  void labelComponents(const std::vector<std::size_t> &component) {
+    m_subtreeComponent.assign(m_order.size(), m_mixed);
+    labelRange(0, m_order.size(), component);
+  }
+
+  // The nearest box in a different component from boxes[query], as
+  // (distance, index); the index is SIZE_MAX if there is none. Call
+  // labelComponents first. Safe to call from several threads at once.
+  std::pair<long long, std::size_t>
+  nearestOutside(std::size_t query,
+                 const std::vector<std::size_t> &component) const {
+    std::pair<long long, std::size_t> best{LLONG_MAX, SIZE_MAX};
+    searchOutside(0, m_order.size(), 0, query, component, best);
+    return best;
+  }
+};
+
+// Yields every pair exactly once, in ascending (distance, i, j) order, without
+// materialising all n(n-1)/2 of them. Box i owns the pairs (i, j) with j < i
+// and walks its k nearest neighbours from the KdTree, doubling k whenever it
+// runs out; a heap merges the per-box streams.
+class NearestEdgeStream {
+private:
+  struct Cursor {
+    std::vector<std::pair<long long, std::size_t>> neighbours{};
+    std::size_t pos{0};
+    std::size_t k{0};
+  };
+
+  const std::vector<junctionBox> &m_boxes;
+  KdTree m_tree;
+  std::vector<Cursor> m_cursors{};
+  std::priority_queue<Triples, std::vector<Triples>,
+                      bool (*)(const Triples &, const Triples &)>
+      m_heap{[](const Triples &a, const Triples &b) {
+        return std::tie(a.distance, a.i, a.j) > std::tie(b.distance, b.i, b.j);
+      }};
+
+  // Moves box i's cursor to its next neighbour j < i and queues that pair.
+  void advance(std::size_t i) {
+    Cursor &cur{m_cursors[i]};
+    const std::size_t others{m_boxes.size() - 1};
+
+    while (true) {
+      if (cur.pos == cur.neighbours.size()) {
+        if (cur.k >= others) {
+          return;
+        }
+        cur.k = std::min(others, 2 * cur.k);
+        cur.neighbours = m_tree.nearest(i, cur.k);
+      }
+
+      const auto &[d, j]{cur.neighbours[cur.pos++]};
+      if (j < i) {
+        m_heap.push(Triples{i, j, d});
+        return;
+      }
+    }
+  }
+
+public:
+  explicit NearestEdgeStream(const std::vector<junctionBox> &boxes,
+                             std::size_t initialK = 8)
+      : m_boxes{boxes}, m_tree{boxes}, m_cursors(boxes.size()) {
+    if (boxes.size() < 2) {
+      return;
+    }
+    const std::size_t k{std::min(std::max<std::size_t>(initialK, 1),
+                                 boxes.size() - 1)};
+    for (std::size_t i{0}; i < boxes.size(); ++i) {
+      m_cursors[i].k = k;
+      m_cursors[i].neighbours = m_tree.nearest(i, k);
+      advance(i);
+    }
+  }
+
+  bool next(Triples &edge) {
+    if (m_heap.empty()) {
+      return false;
+    }
+    edge = m_heap.top();
+    m_heap.pop();
+    advance(edge.i);
+    return true;
+  }
+};
+
+// Hands out pairs in ascending (distance, i, j) order, a batch at a time,
+// holding only O(n + batch) memory. Each refill rescans every pair with the
+// tiled distance kernel, keeps those after the last pair handed out, and
+// selects the batch smallest with nth_element on a buffer that is trimmed
+// whenever it doubles. Batches double in size, so a caller that stops after
+// K pairs pays O(n^2 + K log K) when the first batch is K.
+class SmallestEdgeStream {
+private:
+  BoxCoords m_coords;
+  std::size_t m_batchSize{};
+  std::vector<Triples> m_batch{};
+  std::size_t m_pos{0};
+  bool m_started{false};
+  bool m_exhausted{false};
+  Triples m_last{};
+
+  static bool less(const Triples &a, const Triples &b) {
+    return std::tie(a.distance, a.i, a.j) < std::tie(b.distance, b.i, b.j);
+  }
+
+  void refill() {
+    const std::size_t keep{m_batchSize};
+    std::vector<Triples> buffer{};
+    buffer.reserve(2 * keep);
+    bool haveBound{false};
+    Triples bound{};
+
+    auto trim = [&buffer, &haveBound, &bound, keep]() {
+      std::nth_element(buffer.begin(), buffer.begin() + (keep - 1),
+                       buffer.end(), less);
+      buffer.resize(keep);
+      bound = buffer[keep - 1];
+      haveBound = true;
+    };
+
+    forEachDistanceTile(
+        m_coords, 0, m_coords.size(),
+        [&](std::size_t i, std::size_t jBegin, std::size_t jEnd,
+            const std::int64_t *d) {
+          for (std::size_t j{jBegin}; j < jEnd; ++j) {
+            const Triples edge{i, j, d[j - jBegin]};
+            if ((m_started && !less(m_last, edge)) ||
+                (haveBound && !less(edge, bound))) {
+              continue;
+            }
+            buffer.push_back(edge);
+            if (buffer.size() == 2 * keep) {
+              trim();
+            }
+          }
+        });
+
+    if (buffer.size() > keep) {
+      trim();
+    }
+    std::sort(buffer.begin(), buffer.end(), less);
+
+    m_exhausted = buffer.size() < keep;
+    m_batch = std::move(buffer);
+    m_pos = 0;
+    m_batchSize *= 2;
+  }
+
+public:
+  SmallestEdgeStream(const std::vector<junctionBox> &boxes,
+                     std::size_t batchSize)
+      : m_coords{boxes}, m_batchSize{std::max<std::size_t>(batchSize, 1)} {}
+
+  bool next(Triples &edge) {
+    if (m_pos == m_batch.size()) {
+      if (m_exhausted) {
+        return false;
+      }
+      refill();
+      if (m_batch.empty()) {
+        return false;
+      }
+    }
+    edge = m_batch[m_pos++];
+    m_last = edge;
+    m_started = true;
+    return true;
+  }
+};
+
+// Numbers every box's circuit_num from 1 by its union-find component.
+template <typename UF>
+void labelCircuits(std::vector<junctionBox> &boxes, UF &uf) {
+  const std::vector<std::size_t> ids{uf.componentIds()};
+  for (std::size_t k{0}; k < boxes.size(); ++k) {
+    boxes[k].circuit_num = static_cast<int>(ids[k] + 1);
+  }
+}
+
+// Kruskal over the first numConnections pairs handed out by nextEdge, which
+// must yield pairs in ascending distance and return false when it runs out.
+// UF is the union-find used to track circuits.
+template <typename UF = UnionFind, typename EdgeSource>
+std::vector<Triples> buildCircuitsFrom(std::vector<junctionBox> &boxes,
+                                       EdgeSource nextEdge,
+                                       std::size_t numConnections) {
   const std::size_t n{boxes.size()};
 
   if (n == 0 || numConnections == 0) {
@@ -141,7 +896,7 @@ std::vector<Triples> buildCircuits(std::vector<junctionBox> &boxes,
     return {};
   }
 
-  UnionFind uf{n};
+  UF uf{n};
 
   std::vector<Triples> chosenEdges;
   chosenEdges.reserve(numConnections);
@@ -149,11 +904,8 @@ std::vector<Triples> buildCircuits(std::vector<junctionBox> &boxes,
   std::size_t pairsProcessed{0};
   std::size_t madeConnections{0};
 
-  for (const Triples &edge : sortedDistances) {
-    if (pairsProcessed == numConnections) {
-      break;
-    }
-
+  Triples edge{};
+  while (pairsProcessed < numConnections && nextEdge(edge)) {
     std::size_t a{edge.i};
     std::size_t b{edge.j};
 
@@ -174,51 +926,272 @@ std::vector<Triples> buildCircuits(std::vector<junctionBox> &boxes,
             << ", processed: " << pairsProcessed
             << ", successful merges: " << madeConnections << '\n';
 
-  std::unordered_map<std::size_t, int> rootToCircuit;
-  int nextCircuitId{1};
+  labelCircuits(boxes, uf);
+  return chosenEdges;
+}
 
-  for (std::size_t k{0}; k < n; ++k) {
-    std::size_t root{uf.find(k)};
+std::vector<Triples> buildCircuits(std::vector<junctionBox> &boxes,
+                                   const std::vector<Triples> &sortedDistances,
+                                   std::size_t numConnections) {
+  std::size_t pos{0};
+  return buildCircuitsFrom(
+      boxes,
+      [&sortedDistances, &pos](Triples &edge) {
+        if (pos == sortedDistances.size()) {
+          return false;
+        }
+        edge = sortedDistances[pos++];
+        return true;
+      },
+      numConnections);
+}
 
-    int circuitId;
-    auto it{rootToCircuit.find(root)};
-    if (it == rootToCircuit.end()) {
-      circuitId = nextCircuitId;
-      rootToCircuit[root] = circuitId;
-      ++nextCircuitId;
-    } else {
-      circuitId = it->second;
-    }
+std::vector<Triples> buildCircuits(std::vector<junctionBox> &boxes,
+                                   NearestEdgeStream &edges,
+                                   std::size_t numConnections) {
+  return buildCircuitsFrom(
+      boxes, [&edges](Triples &edge) { return edges.next(edge); },
+      numConnections);
+}
 
-    boxes[k].circuit_num = circuitId;
+std::vector<Triples> buildCircuits(std::vector<junctionBox> &boxes,
+                                   const PackedEdges &sortedEdges,
+                                   std::size_t numConnections) {
+  std::size_t pos{0};
+  return buildCircuitsFrom(
+      boxes,
+      [&sortedEdges, &pos](Triples &edge) {
+        if (pos == sortedEdges.size()) {
+          return false;
+        }
+        edge = sortedEdges[pos++];
+        return true;
+      },
+      numConnections);
+}
+
+// Keeps the edges whose ends are still in different circuits, in their
+// original order. Each thread screens its own slice against the shared
+// ConcurrentUnionFind.
+std::vector<Triples> filterCrossEdges(const Triples *begin, const Triples *end,
+                                      ConcurrentUnionFind &uf,
+                                      unsigned threadCount) {
+  threadCount = std::max(1U, threadCount);
+  std::vector<std::vector<Triples>> kept(threadCount);
+
+  parallelFor(static_cast<std::size_t>(end - begin), threadCount,
+              [&](unsigned t, std::size_t lo, std::size_t hi) {
+                for (std::size_t k{lo}; k < hi; ++k) {
+                  if (!uf.same(begin[k].i, begin[k].j)) {
+                    kept[t].push_back(begin[k]);
+                  }
+                }
+              });
+
+  std::vector<Triples> survivors{};
+  for (const std::vector<Triples> &part : kept) {
+    survivors.insert(survivors.end(), part.begin(), part.end());
+  }
+  return survivors;
+}
+
+// Filter-Kruskal version of buildCircuits: the sorted pairs are taken a
+// chunk at a time, pairs already inside one circuit are dropped by
+// filterCrossEdges in parallel, and only the survivors reach the sequential
+// unite loop. Every pair in the first numConnections still counts as
+// processed.
+std::vector<Triples> buildCircuits(std::vector<junctionBox> &boxes,
+                                   const std::vector<Triples> &sortedDistances,
+                                   std::size_t numConnections,
+                                   unsigned threadCount,
+                                   std::size_t chunkSize = 1 << 14) {
+  const std::size_t n{boxes.size()};
+  const std::size_t limit{std::min(numConnections, sortedDistances.size())};
+
+  ConcurrentUnionFind uf{n};
+  std::vector<Triples> chosenEdges{};
+
+  for (std::size_t start{0}; start < limit; start += chunkSize) {
+    const Triples *begin{sortedDistances.data() + start};
+    const Triples *end{sortedDistances.data() +
+                       std::min(limit, start + chunkSize)};
+
+    for (const Triples &edge :
+         filterCrossEdges(begin, end, uf, threadCount)) {
+      if (edge.i < n && edge.j < n && uf.unite(edge.i, edge.j)) {
+        chosenEdges.push_back(edge);
+      }
+    }
   }
 
+  std::cout << "Requested pairs: " << numConnections
+            << ", processed: " << limit
+            << ", successful merges: " << chosenEdges.size() << '\n';
+
+  labelCircuits(boxes, uf);
   return chosenEdges;
 }
 
+struct MinimumSpanningTree {
+  std::vector<Triples> edges{};
+  Triples lastMerge{};
+};
+
+// Borůvka's algorithm: each round, every box finds its nearest box in
+// another circuit (in parallel, through the KdTree), each circuit keeps its
+// cheapest such edge, and all of those are merged. Ties are broken on
+// (distance, i, j), the same order Kruskal uses, so the MST's heaviest edge
+// is exactly the connection that would finally join everything.
+MinimumSpanningTree boruvkaMST(const std::vector<junctionBox> &boxes,
+                               unsigned threadCount) {
+  const std::size_t n{boxes.size()};
+  MinimumSpanningTree mst{};
+  if (n < 2) {
+    return mst;
+  }
+
+  KdTree tree{boxes};
+  UnionFind uf{n};
+  std::vector<Triples> nearest(n);
+  const Triples none{0, 0, LLONG_MAX};
+
+  auto edgeLess = [](const Triples &a, const Triples &b) {
+    return std::tie(a.distance, a.i, a.j) < std::tie(b.distance, b.i, b.j);
+  };
+
+  while (uf.countSets() > 1) {
+    const std::vector<std::size_t> component{uf.componentIds()};
+    tree.labelComponents(component);
+
+    parallelFor(n, threadCount, [&](unsigned, std::size_t lo, std::size_t hi) {
+      for (std::size_t p{lo}; p < hi; ++p) {
+        auto [d, q]{tree.nearestOutside(p, component)};
+        nearest[p] = Triples{std::max(p, q), std::min(p, q), d};
+      }
+    });
+
+    std::vector<Triples> cheapest(uf.countSets(), none);
+    for (std::size_t p{0}; p < n; ++p) {
+      Triples &best{cheapest[component[p]]};
+      if (edgeLess(nearest[p], best)) {
+        best = nearest[p];
+      }
+    }
+
+    for (const Triples &edge : cheapest) {
+      if (edge.distance != LLONG_MAX && uf.unite(edge.i, edge.j)) {
+        mst.edges.push_back(edge);
+      }
+    }
+  }
+
+  std::sort(mst.edges.begin(), mst.edges.end(), edgeLess);
+  mst.lastMerge = mst.edges.back();
+  return mst;
+}
+
+// Kruskal one edge at a time. After every edge the circuit count and the
+// three largest circuit sizes are recorded, so the state after any earlier
+// number of connections can be read back without replaying.
+class CircuitTracker {
+public:
+  struct Step {
+    std::size_t circuits{};
+    std::array<std::size_t, 3> largest{};
+  };
+
+private:
+  UnionFind m_uf;
+  std::multiset<std::size_t, std::greater<>> m_sizes{};
+  std::vector<Step> m_history{};
+  std::size_t m_completedAt{0};
+  Triples m_finalEdge{};
+
+  Step snapshot() const {
+    Step step{m_sizes.size(), {}};
+    auto it{m_sizes.begin()};
+    for (std::size_t k{0}; k < step.largest.size() && it != m_sizes.end();
+         ++k, ++it) {
+      step.largest[k] = *it;
+    }
+    return step;
+  }
+
+public:
+  explicit CircuitTracker(std::size_t n) : m_uf{n} {
+    for (std::size_t k{0}; k < n; ++k) {
+      m_sizes.insert(1);
+    }
+    m_history.push_back(snapshot());
+  }
+
+  // Returns true if the edge merged two circuits.
+  bool connect(const Triples &edge) {
+    std::size_t rootA{m_uf.find(edge.i)};
+    std::size_t rootB{m_uf.find(edge.j)};
+    bool merged{false};
+
+    if (rootA != rootB) {
+      std::size_t sizeA{m_uf.componentSize(rootA)};
+      std::size_t sizeB{m_uf.componentSize(rootB)};
+
+      m_uf.unite(rootA, rootB);
+      m_sizes.erase(m_sizes.find(sizeA));
+      m_sizes.erase(m_sizes.find(sizeB));
+      m_sizes.insert(sizeA + sizeB);
+      merged = true;
+    }
+
+    m_history.push_back(snapshot());
+
+    if (merged && m_sizes.size() == 1) {
+      m_completedAt = connections();
+      m_finalEdge = edge;
+    }
+    return merged;
+  }
+
+  std::size_t connections() const { return m_history.size() - 1; }
+  std::size_t circuitCount() const { return m_sizes.size(); }
+
+  // State after the first n connections, n <= connections().
+  const Step &stateAfter(std::size_t n) const { return m_history.at(n); }
+
+  bool isComplete() const { return m_sizes.size() <= 1; }
+
+  // Number of connections after which everything became one circuit, and
+  // the edge that did it. Only meaningful once isComplete().
+  std::size_t completedAt() const { return m_completedAt; }
+  const Triples &finalEdge() const { return m_finalEdge; }
+};
+
+// Every circuit's size, largest first (ties by circuit number). Counting and
+// bucketing by size keep it O(n).
 std::vector<std::pair<std::size_t, int>>
 countLargestCircuits(const std::vector<junctionBox> &boxes) {
   std::size_t n{boxes.size()};
 
-  std::vector<std::pair<std::size_t, int>> circuitSizes;
-  circuitSizes.reserve(n);
+  std::vector<int> counts(n + 1, 0);
+  for (const auto &box : boxes) {
+    std::size_t circuit{static_cast<std::size_t>(box.circuit_num)};
+    if (circuit >= 1 && circuit <= n) {
+      ++counts[circuit];
+    }
+  }
 
+  std::vector<std::size_t> bucketStart(n + 2, 0);
   for (std::size_t i{1}; i <= n; ++i) {
-    int count{0};
-    for (const auto &box : boxes) {
-      if (box.circuit_num == i)
-        ++count;
-    }
-    circuitSizes.push_back(std::pair(i, count));
+    ++bucketStart[n - static_cast<std::size_t>(counts[i]) + 1];
+  }
+  for (std::size_t s{1}; s < bucketStart.size(); ++s) {
+    bucketStart[s] += bucketStart[s - 1];
   }
 
-  std::sort(
-      circuitSizes.begin(), circuitSizes.end(),
-      [](const std::pair<size_t, int> &a, const std::pair<size_t, int> &b) {
-        if (a.second != b.second)
-          return a.second > b.second;
-        return a.first < b.first;
-      });
+  std::vector<std::pair<std::size_t, int>> circuitSizes(n);
+  for (std::size_t i{1}; i <= n; ++i) {
+    std::size_t bucket{n - static_cast<std::size_t>(counts[i])};
+    circuitSizes[bucketStart[bucket]++] = std::pair(i, counts[i]);
+  }
 
   return circuitSizes;
 }
@@ -226,46 +1199,32 @@ countLargestCircuits(const std::vector<junctionBox> &boxes) {
 int main() {
   std::vector<junctionBox> boxes{readBoxes("input.txt")};
 
-  /*  for (const auto &position : positions) {
-      std::cout << "position " << position.label << " has the coordiantes:\n"
-                << "x: " << position.x << " y: " << position.y
-                << " z: " << position.y << '\n';
-    }
-  */
-
-  std::vector<Triples> sortedDistances{sortDistance(boxes)};
-
-  /*for (const auto &d : sortedDistances) {
-    std::cout << std::fixed << std::setprecision(15) << "Junction boxes ("
-              << d.i << ',' << d.j << ") have a distance: " << d.distance
-              << '\n';
-  }*/
+  const std::size_t part1Connections{1000};
 
-  for (int n{1}; n < 10000; ++n) {
-    std::vector<Triples> wires{buildCircuits(boxes, sortedDistances, n)};
-    std::vector<std::pair<std::size_t, int>> circuitSizes{
-        countLargestCircuits(boxes)};
+  SmallestEdgeStream edges{boxes, part1Connections};
+  CircuitTracker tracker{boxes.size()};
+  Triples edge{};
 
-    for (const auto &circuit : circuitSizes) {
-      if (circuit.second != 0) {
-        std::cout << "Circuit " << circuit.first << " contains "
-                  << circuit.second << " junction boxes." << '\n';
-      }
-    }
+  while (tracker.connections() < part1Connections && edges.next(edge)) {
+    tracker.connect(edge);
   }
 
-  std::cout << boxes[sortedDistances[5041].i].x *
-                   boxes[sortedDistances[5041].j].x
-            << '\n';
+  if (tracker.connections() == part1Connections) {
+    const CircuitTracker::Step &step{tracker.stateAfter(part1Connections)};
+    std::cout << "Multiplying together the sizes of the three largest "
+                 "circuits gives: "
+              << step.largest[0] * step.largest[1] * step.largest[2] << '\n';
+  }
 
-  /* std::cout
-       << "Multiplying together the sizes of the three largest circuits gives:
-     "
-       << circuitSizes[0].second * circuitSizes[1].second *
-              circuitSizes[2].second
-       << '\n'
-       << sortedDistances.size() << '\n';
-       */
+  if (boxes.size() > 1) {
+    const MinimumSpanningTree mst{
+        boruvkaMST(boxes, std::thread::hardware_concurrency())};
+    const Triples &last{mst.lastMerge};
+    std::cout << "The last connection joins boxes " << last.i << " and "
+              << last.j << ": "
+              << static_cast<long long>(boxes[last.i].x) * boxes[last.j].x
+              << '\n';
+  }
 
   return 0;
 }